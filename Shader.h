@@ -2,10 +2,36 @@
 
 #include <glad/glad.h>
 
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Linked programs are stored here, keyed by a hash of their sources and the
+// driver, so later launches skip compiling
+#define SHADER_CACHE_DIRECTORY "ShaderCache"
+#define SHADER_CACHE_MAGIC     0x4e494250 // "PBIN"
+
+// GL_KHR_parallel_shader_compile, which the generated glad doesn't load
+#ifndef GL_COMPLETION_STATUS_KHR
+	#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+	#define GL_COMPLETION_STATUS_KHR           0x91B1
+#endif
+typedef void (APIENTRYP shader_compiler_threads_proc)(GLuint count);
+
+struct shader_cache_header
+{
+	uint32_t magic;
+	uint32_t format;
+	uint64_t key;
+	uint32_t length;
+};
 
 class Shader
 {
@@ -43,57 +69,316 @@ public:
 		{
 			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
 		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char* fShaderCode = fragmentCode.c_str();
-		// 2. compile shaders
-		unsigned int vertex, fragment;
-		// vertex shader
-		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, NULL);
-		glCompileShader(vertex);
-		checkCompileErrors(vertex, "VERTEX");
-		// fragment Shader
-		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL);
-		glCompileShader(fragment);
-		checkCompileErrors(fragment, "FRAGMENT");
-		// shader Program
-		ID = glCreateProgram();
-		glAttachShader(ID, vertex);
-		glAttachShader(ID, fragment);
-		glLinkProgram(ID);
-		checkCompileErrors(ID, "PROGRAM");
-		// delete the shaders as they're linked into our program now and no longer necessary
-		glDeleteShader(vertex);
-		glDeleteShader(fragment);
+		// 2. load the cached binary or compile
+		stages.push_back({ GL_VERTEX_SHADER, "VERTEX", vertexCode, 0 });
+		stages.push_back({ GL_FRAGMENT_SHADER, "FRAGMENT", fragmentCode, 0 });
+		Build();
+	}
+	// constructor for a compute-only program
+	// ------------------------------------------------------------------------
+	Shader(const char* computePath)
+	{
+		// 1. retrieve the compute source code from filePath
+		std::string computeCode;
+		std::ifstream cShaderFile;
+		try
+		{
+			cShaderFile.open(computePath);
+			std::stringstream cShaderStream;
+			cShaderStream << cShaderFile.rdbuf();
+			cShaderFile.close();
+			computeCode = cShaderStream.str();
+		}
+		catch (std::ifstream::failure e)
+		{
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+		}
+		// 2. load the cached binary or compile
+		stages.push_back({ GL_COMPUTE_SHADER, "COMPUTE", computeCode, 0 });
+		Build();
+	}
+	// lets the driver compile on its own threads. Call once after loading GL,
+	// before creating any shader
+	// ------------------------------------------------------------------------
+	static void EnableParallelCompile(GLADloadproc load)
+	{
+		const char* names[] = { "glMaxShaderCompilerThreadsKHR", "glMaxShaderCompilerThreadsARB" };
+		const char* extensions[] = { "GL_KHR_parallel_shader_compile", "GL_ARB_parallel_shader_compile" };
+		for (int i = 0; i < 2; i++)
+		{
+			shader_compiler_threads_proc maxThreads = (shader_compiler_threads_proc)load(names[i]);
+			if (HasExtension(extensions[i]) && maxThreads)
+			{
+				maxThreads(0xFFFFFFFF);
+				ParallelCompile() = true;
+				return;
+			}
+		}
+	}
+	// false while the driver is still compiling in the background. Without
+	// parallel compile everything is done by the first Bind anyway
+	// ------------------------------------------------------------------------
+	bool IsReady()
+	{
+		if (checked || !ParallelCompile())
+			return true;
+		int complete = 0;
+		glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &complete);
+		return complete != 0;
 	}
 	// activate the shader
 	// ------------------------------------------------------------------------
 	void Bind()
 	{
+		if (!checked)
+			Finish();
 		glUseProgram(ID);
 	}
+	// uniform locations are looked up once per name
+	// ------------------------------------------------------------------------
+	int GetUniformLocation(const std::string& name)
+	{
+		std::unordered_map<std::string, int>::iterator cached = uniformLocations.find(name);
+		if (cached != uniformLocations.end())
+			return cached->second;
+		if (!checked)
+			Finish();
+		int location = glGetUniformLocation(ID, name.c_str());
+		uniformLocations[name] = location;
+		return location;
+	}
+	// the block is bound to a fixed binding point, since GLSL 4.10 can't say
+	// so in the shader. Deferred until the program is linked
+	// ------------------------------------------------------------------------
+	void BindUniformBlock(const char* name, unsigned int binding)
+	{
+		uniformBlocks.push_back({ name, binding });
+		if (checked)
+			ApplyUniformBlocks();
+	}
+	// integer uniforms that only change with what the program is used with,
+	// like sampler units and atlas layouts, so they're set once rather than
+	// per draw. Through glProgramUniform, so the program needn't be bound,
+	// and deferred until it is linked
+	// ------------------------------------------------------------------------
+	void SetProgramInt(const char* name, int x)
+	{
+		programInts.push_back({ name, 1, x, 0 });
+		if (checked)
+			ApplyProgramInts();
+	}
+	void SetProgramInt2(const char* name, int x, int y)
+	{
+		programInts.push_back({ name, 2, x, y });
+		if (checked)
+			ApplyProgramInts();
+	}
 	// utility uniform functions
 	// ------------------------------------------------------------------------
-	void setBool(const std::string& name, bool value) const
+	void setBool(const std::string& name, bool value)
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		glUniform1i(GetUniformLocation(name), (int)value);
 	}
 	// ------------------------------------------------------------------------
-	void setInt(const std::string& name, int value) const
+	void setInt(const std::string& name, int value)
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1i(GetUniformLocation(name), value);
 	}
 	// ------------------------------------------------------------------------
-	void setFloat(const std::string& name, float value) const
+	void setFloat(const std::string& name, float value)
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1f(GetUniformLocation(name), value);
 	}
 
 private:
+	struct stage
+	{
+		GLenum type;
+		const char* name;
+		std::string source;
+		unsigned int id;
+	};
+
+	struct program_int
+	{
+		std::string name;
+		int components;
+		int x, y;
+	};
+
+	std::vector<stage> stages;
+	std::unordered_map<std::string, int> uniformLocations;
+	std::vector<std::pair<std::string, unsigned int>> uniformBlocks;
+	std::vector<program_int> programInts;
+	uint64_t cacheKey = 0;
+	// compile/link results have been checked, see Finish
+	bool checked = false;
+
+	static bool& ParallelCompile()
+	{
+		static bool enabled = false;
+		return enabled;
+	}
+	static bool HasExtension(const char* name)
+	{
+		int count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (int i = 0; i < count; i++)
+		{
+			if (std::string((const char*)glGetStringi(GL_EXTENSIONS, i)) == name)
+				return true;
+		}
+		return false;
+	}
+	// FNV-1a over the sources and the driver strings, so a driver update
+	// invalidates the binaries it can't load anyway
+	// ------------------------------------------------------------------------
+	uint64_t ComputeCacheKey()
+	{
+		uint64_t hash = 14695981039346656037ull;
+		auto mix = [&](const std::string& text) {
+			for (unsigned char c : text)
+			{
+				hash ^= c;
+				hash *= 1099511628211ull;
+			}
+			hash ^= 0xff;
+			hash *= 1099511628211ull;
+		};
+		for (const stage& s : stages)
+			mix(s.source);
+		GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+		for (GLenum name : strings)
+			mix((const char*)glGetString(name));
+		return hash;
+	}
+	std::string CachePath()
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)cacheKey);
+		return std::string(SHADER_CACHE_DIRECTORY) + "/" + name;
+	}
+	// ------------------------------------------------------------------------
+	bool LoadBinary()
+	{
+		int formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		if (formats == 0)
+			return false;
+
+		std::string path = CachePath();
+		std::error_code error;
+		uintmax_t fileSize = std::filesystem::file_size(path, error);
+		if (error)
+			return false;
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+		shader_cache_header header;
+		if (!file.read((char*)&header, sizeof(header)) || header.magic != SHADER_CACHE_MAGIC || header.key != cacheKey)
+			return false;
+		// a truncated or corrupt file is a miss, not a huge allocation
+		if (header.length == 0 || header.length != fileSize - sizeof(header))
+			return false;
+		std::vector<char> binary(header.length);
+		if (!file.read(binary.data(), binary.size()))
+			return false;
+
+		// a binary the driver no longer accepts just fails to link
+		glProgramBinary(ID, header.format, binary.data(), (GLsizei)binary.size());
+		int success = 0;
+		glGetProgramiv(ID, GL_LINK_STATUS, &success);
+		return success != 0;
+	}
+	// ------------------------------------------------------------------------
+	void SaveBinary()
+	{
+		int length = 0;
+		glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+			return;
+
+		shader_cache_header header;
+		std::vector<char> binary(length);
+		glGetProgramBinary(ID, length, nullptr, &header.format, binary.data());
+		header.magic  = SHADER_CACHE_MAGIC;
+		header.key    = cacheKey;
+		header.length = (uint32_t)length;
+
+		std::error_code error;
+		std::filesystem::create_directories(SHADER_CACHE_DIRECTORY, error);
+		std::ofstream file(CachePath(), std::ios::binary);
+		file.write((const char*)&header, sizeof(header));
+		file.write(binary.data(), binary.size());
+	}
+	// issues the compile and link without asking for the result, so with
+	// parallel compile the driver works on several programs at once
+	// ------------------------------------------------------------------------
+	void Build()
+	{
+		ID = glCreateProgram();
+		cacheKey = ComputeCacheKey();
+		if (LoadBinary())
+		{
+			checked = true;
+			stages.clear();
+			return;
+		}
+
+		for (stage& s : stages)
+		{
+			const char* code = s.source.c_str();
+			s.id = glCreateShader(s.type);
+			glShaderSource(s.id, 1, &code, NULL);
+			glCompileShader(s.id);
+			glAttachShader(ID, s.id);
+		}
+		glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(ID);
+	}
+	// waits for the compile and link, reports errors and caches the binary
+	// ------------------------------------------------------------------------
+	void Finish()
+	{
+		for (stage& s : stages)
+			checkCompileErrors(s.id, s.name);
+		if (checkCompileErrors(ID, "PROGRAM"))
+			SaveBinary();
+		// delete the shaders as they're linked into our program now and no longer necessary
+		for (stage& s : stages)
+			glDeleteShader(s.id);
+		stages.clear();
+		checked = true;
+		ApplyUniformBlocks();
+		ApplyProgramInts();
+	}
+	// ------------------------------------------------------------------------
+	void ApplyUniformBlocks()
+	{
+		for (const std::pair<std::string, unsigned int>& block : uniformBlocks)
+		{
+			unsigned int index = glGetUniformBlockIndex(ID, block.first.c_str());
+			if (index != GL_INVALID_INDEX)
+				glUniformBlockBinding(ID, index, block.second);
+		}
+		uniformBlocks.clear();
+	}
+	// ------------------------------------------------------------------------
+	void ApplyProgramInts()
+	{
+		for (const program_int& value : programInts)
+		{
+			int location = GetUniformLocation(value.name);
+			if (value.components == 1)
+				glProgramUniform1i(ID, location, value.x);
+			else
+				glProgramUniform2i(ID, location, value.x, value.y);
+		}
+		programInts.clear();
+	}
 	// utility function for checking shader compilation/linking errors.
 	// ------------------------------------------------------------------------
-	void checkCompileErrors(unsigned int shader, std::string type)
+	bool checkCompileErrors(unsigned int shader, std::string type)
 	{
 		int success;
 		char infoLog[1024];
@@ -115,5 +400,6 @@ private:
 				std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
 			}
 		}
+		return success != 0;
 	}
 };
@@ -1,8 +1,13 @@
 #version 410 core
 
 in vec4 Color;
+in vec2 TexCoord;
+flat in int Textured;
 out vec4 FragColor;
 
+uniform sampler2D atlas;
+
 void main() {
-    FragColor = Color;
+    // Sprites are white shapes in alpha, tinted by the particle color
+    FragColor = Textured != 0 ? Color * texture(atlas, TexCoord) : Color;
 }
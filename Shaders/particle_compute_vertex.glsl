@@ -0,0 +1,46 @@
+#version 430 core
+
+layout (location = 0) in vec2 aPos;
+
+struct particle
+{
+    vec2 position;
+    vec2 speed;
+    vec4 colorBegin;
+    vec4 colorEnd;
+    vec4 color;
+    vec2 scaleBegin;
+    vec2 scaleEnd;
+    vec2 scale;
+    float currentLife;
+    float totalLife;
+};
+
+layout (std430, binding = 0) readonly buffer Particles { particle particles[]; };
+
+out vec4 Color;
+// Shared fragment shader, the GPU simulation draws without sprites
+out vec2 TexCoord;
+flat out int Textured;
+
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+};
+uniform float rewind;
+
+void main()
+{
+    particle p = particles[gl_InstanceID];
+
+    // Never further back than the particle has lived
+    float back = min(rewind, p.totalLife - p.currentLife);
+    vec2 position = p.position - p.speed * back;
+
+    // Clamped like the RGBA8 instances of the CPU path
+    Color = clamp(p.color, 0.0, 1.0);
+    TexCoord = vec2(0.0);
+    Textured = 0;
+    gl_Position = projection * view * vec4(position + aPos * p.scale, 0.0, 1.0);
+}
@@ -1,16 +1,48 @@
 #version 410 core
 
 layout (location = 0) in vec2 aPos;
-layout (location = 1) in vec4 instanceColor;
-layout (location = 2) in mat4 instanceModel;
+layout (location = 1) in vec3 instancePosition;
+layout (location = 2) in vec2 instanceScale;
+layout (location = 3) in vec4 instanceColor;
+layout (location = 4) in uint instanceFrame;
 
 out vec4 Color;
+out vec2 TexCoord;
+flat out int Textured;
 
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+};
+
+uniform sampler2D atlas;
+uniform ivec2 atlasGrid; // Columns, rows
+
+const uint NO_SPRITE = 0xFFFFFFFFu;
 
 void main()
 {
     Color = instanceColor;
-    gl_Position = projection * view * instanceModel * vec4(aPos, 0.0, 1.0);
+
+    // Cell of the frame, numbered row by row from the top left. The corner
+    // is kept half a texel inside so filtering stays within the cell. The
+    // quad's +y side ends up at the top of the screen when projection keeps
+    // y up (3D) and at the bottom under the 2D y-down ortho, so the cell's
+    // top row follows the sign of projection[1][1]
+    Textured = instanceFrame != NO_SPRITE ? 1 : 0;
+    vec2 cellSize = 1.0 / vec2(atlasGrid);
+    vec2 inset    = 0.5 / vec2(textureSize(atlas, 0));
+    vec2 cell     = vec2(instanceFrame % uint(atlasGrid.x), instanceFrame / uint(atlasGrid.x));
+    vec2 uv       = vec2(aPos.x + 0.5, 0.5 - sign(projection[1][1]) * aPos.y);
+    vec2 corner   = clamp(uv, inset / cellSize, 1.0 - inset / cellSize);
+    TexCoord = (cell + corner) * cellSize;
+
+    // The first two rows of the view rotation are the camera's right and up
+    // in world space, so the quad faces the camera without a matrix per
+    // particle. The 2D identity view gives the plain xy quad
+    vec3 right = vec3(view[0][0], view[1][0], view[2][0]);
+    vec3 up    = vec3(view[0][1], view[1][1], view[2][1]);
+    vec3 world = instancePosition + right * (aPos.x * instanceScale.x) + up * (aPos.y * instanceScale.y);
+    gl_Position = projection * view * vec4(world, 1.0);
 }
@@ -0,0 +1,675 @@
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "particle_system.h"
+#include "particle_instance.h"
+
+// scaling: particle_system::Update from 1 to N threads on identical state,
+//          checking that every thread count produces the same particles
+// layouts: the update kernel over the old one-vector-per-column layout, the
+//          SoA arena and 8/16 wide AoSoA blocks
+// suite:   every stage of the pipeline at 10k..maxParticles particles in
+//          steady, affectors, lifetime, burst, interaction and churn scenarios, as JSON for
+//          tracking across releases
+// Usage: particles_benchmark scaling [particles] [frames] [maxThreads]
+//        particles_benchmark layouts [particles] [frames]
+//        particles_benchmark suite [maxParticles] [threads] > results.json
+
+struct column_snapshot
+{
+    std::vector<glm::vec2> position, speed, scaleBegin, scaleEnd, scale;
+    std::vector<glm::vec4> colorBegin, colorEnd, color;
+    std::vector<float> currentLife, totalLife;
+    int lastActiveParticle;
+
+    template <typename T>
+    static void Copy(std::vector<T>& dst, const T* src, int count) { dst.assign(src, src + count); }
+
+    template <typename T>
+    static void Copy(T* dst, const std::vector<T>& src) { std::copy(src.begin(), src.end(), dst); }
+
+    void Save(const particle_system& p)
+    {
+        int n = p.totalParticles;
+        Copy(position, p.position, n); Copy(speed, p.speed, n);
+        Copy(colorBegin, p.colorBegin, n); Copy(colorEnd, p.colorEnd, n); Copy(color, p.color, n);
+        Copy(scaleBegin, p.scaleBegin, n); Copy(scaleEnd, p.scaleEnd, n); Copy(scale, p.scale, n);
+        Copy(currentLife, p.currentLife, n); Copy(totalLife, p.totalLife, n);
+        lastActiveParticle = p.lastActiveParticle;
+    }
+
+    void Restore(particle_system& p) const
+    {
+        Copy(p.position, position); Copy(p.speed, speed);
+        Copy(p.colorBegin, colorBegin); Copy(p.colorEnd, colorEnd); Copy(p.color, color);
+        Copy(p.scaleBegin, scaleBegin); Copy(p.scaleEnd, scaleEnd); Copy(p.scale, scale);
+        Copy(p.currentLife, currentLife); Copy(p.totalLife, totalLife);
+        p.lastActiveParticle = lastActiveParticle;
+    }
+};
+
+template <typename T>
+static uint64_t HashColumn(uint64_t hash, const T* column, int count)
+{
+    const unsigned char* bytes = (const unsigned char*)column;
+    for (size_t i = 0; i < count * sizeof(T); i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static uint64_t HashState(const particle_system& p)
+{
+    int count = p.lastActiveParticle + 1;
+    uint64_t hash = 14695981039346656037ull;
+    hash = HashColumn(hash, p.position, count);
+    hash = HashColumn(hash, p.color, count);
+    hash = HashColumn(hash, p.scale, count);
+    hash = HashColumn(hash, p.currentLife, count);
+    return hash;
+}
+
+static int RunScaling(int argc, char* argv[])
+{
+    int particles  = argc > 2 ? std::atoi(argv[2]) : 1 << 20;
+    int frames     = argc > 3 ? std::atoi(argv[3]) : 100;
+    int maxThreads = argc > 4 ? std::atoi(argv[4]) : (int)std::thread::hardware_concurrency();
+    if (maxThreads <= 0) {
+        maxThreads = 1;
+    }
+
+    particle_data data = {};
+    data.speed        = glm::vec2(1, 1);
+    data.colorBegin   = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
+    data.colorEnd     = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+    data.scaleBegin   = glm::vec2(0.0f, 0.0f);
+    data.scaleEnd     = glm::vec2(4.5f, 4.5f);
+    // Long enough that nobody dies and every run updates the same count
+    data.totalLife    = 1000.0f;
+
+    particle_system particleSystem(particles);
+    particleSystem.particleData = data;
+    particleSystem.ParticleBurst(particles);
+
+    column_snapshot initial;
+    initial.Save(particleSystem);
+
+    std::vector<int> threadCounts;
+    for (int t = 1; t < maxThreads; t *= 2) {
+        threadCounts.push_back(t);
+    }
+    threadCounts.push_back(maxThreads);
+
+    job_system jobs(1);
+    particleSystem.jobSystem = &jobs;
+
+    std::cout << "Update scaling | " << particles << " particles | " << frames << " frames | "
+              << GetSimdLevelName(particleSystem.simdLevel) << std::endl;
+
+    timestep ts = 1.0f / 60.0f;
+    double baselineMs = 0.0;
+    uint64_t baselineHash = 0;
+
+    for (int threadCount : threadCounts) {
+        jobs.SetThreadCount(threadCount);
+        initial.Restore(particleSystem);
+
+        // Warm up caches and wake the workers
+        particleSystem.Update(ts);
+        initial.Restore(particleSystem);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < frames; frame++) {
+            particleSystem.Update(ts);
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        double ms = std::chrono::duration<double, std::milli>(end - start).count() / frames;
+        uint64_t hash = HashState(particleSystem);
+        if (threadCount == 1) {
+            baselineMs   = ms;
+            baselineHash = hash;
+        }
+
+        std::cout << "Threads: " << threadCount
+                  << " | Ms / update: " << ms
+                  << " | Ns / particle: " << ms * 1e6 / particles
+                  << " | Speedup: " << baselineMs / ms
+                  << " | Deterministic: " << (hash == baselineHash ? "yes" : "NO") << std::endl;
+    }
+
+    return 0;
+}
+
+// The column layout particle_system used before the arena: one heap
+// allocated vector per column, and 2D scale padded to vec3
+struct legacy_columns
+{
+    std::unique_ptr<std::vector<glm::vec2>> position, speed;
+    std::unique_ptr<std::vector<glm::vec4>> colorBegin, colorEnd, color;
+    std::unique_ptr<std::vector<glm::vec3>> scaleBegin, scaleEnd, scale;
+    std::unique_ptr<std::vector<float>> currentLife, totalLife;
+
+    legacy_columns(int n)
+    {
+        position    = std::make_unique<std::vector<glm::vec2>>(n);
+        speed       = std::make_unique<std::vector<glm::vec2>>(n);
+        colorBegin  = std::make_unique<std::vector<glm::vec4>>(n);
+        colorEnd    = std::make_unique<std::vector<glm::vec4>>(n);
+        color       = std::make_unique<std::vector<glm::vec4>>(n);
+        scaleBegin  = std::make_unique<std::vector<glm::vec3>>(n);
+        scaleEnd    = std::make_unique<std::vector<glm::vec3>>(n);
+        scale       = std::make_unique<std::vector<glm::vec3>>(n);
+        currentLife = std::make_unique<std::vector<float>>(n);
+        totalLife   = std::make_unique<std::vector<float>>(n);
+    }
+
+    void Update(int count, float delta)
+    {
+        for (int i = 0; i < count; i++) {
+            (*currentLife)[i] -= delta;
+            (*position)[i]    += (*speed)[i] * delta;
+            (*color)[i] = glm::mix((*colorEnd)[i], (*colorBegin)[i], (*currentLife)[i] / (*totalLife)[i]);
+            (*scale)[i] = glm::mix((*scaleEnd)[i], (*scaleBegin)[i], (*currentLife)[i] / (*totalLife)[i]);
+        }
+    }
+};
+
+template <int BlockWidth>
+static particle_columns BlockColumns(particle_storage_layout<BlockWidth>& storage, int block)
+{
+    particle_columns columns;
+    columns.position    = storage.template Block<position_column>(block);
+    columns.prevPosition = storage.template Block<prev_position_column>(block);
+    columns.speed       = storage.template Block<speed_column>(block);
+    columns.colorBegin  = storage.template Block<color_begin_column>(block);
+    columns.colorEnd    = storage.template Block<color_end_column>(block);
+    columns.color       = storage.template Block<color_column>(block);
+    columns.scaleBegin  = storage.template Block<scale_begin_column>(block);
+    columns.scaleEnd    = storage.template Block<scale_end_column>(block);
+    columns.scale       = storage.template Block<scale_column>(block);
+    columns.currentLife = storage.template Block<current_life_column>(block);
+    columns.totalLife   = storage.template Block<total_life_column>(block);
+    columns.age         = storage.template Block<age_column>(block);
+    columns.inverseLife = storage.template Block<inverse_life_column>(block);
+    columns.lut         = nullptr;
+    return columns;
+}
+
+// Same values in every layout, so each one runs identical math
+template <typename Storage>
+static void FillStorage(Storage& storage, int count)
+{
+    for (int i = 0; i < count; i++) {
+        float f = (float)(i % 997);
+        storage.template Get<position_column>(i)     = glm::vec2(f, -f);
+        storage.template Get<speed_column>(i)        = glm::vec2(1.0f + f * 0.01f, 2.0f);
+        storage.template Get<color_begin_column>(i)  = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
+        storage.template Get<color_end_column>(i)    = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+        storage.template Get<scale_begin_column>(i)  = glm::vec2(0.0f);
+        storage.template Get<scale_end_column>(i)    = glm::vec2(4.5f);
+        storage.template Get<current_life_column>(i) = 1000.0f;
+        storage.template Get<total_life_column>(i)   = 1000.0f;
+    }
+}
+
+template <typename Fn>
+static double TimeMs(int frames, Fn fn)
+{
+    fn();
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++) {
+        fn();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / frames;
+}
+
+static void PrintLayout(const char* name, const char* kernel, double ms, int particles)
+{
+    std::cout << name << " (" << kernel << ")"
+              << " | Ms / update: " << ms
+              << " | Ns / particle: " << ms * 1e6 / particles << std::endl;
+}
+
+static int RunLayouts(int argc, char* argv[])
+{
+    int particles = argc > 2 ? std::atoi(argv[2]) : 1 << 20;
+    int frames    = argc > 3 ? std::atoi(argv[3]) : 100;
+    float delta   = 1.0f / 60.0f;
+
+    simd_level best = DetectSimdLevel();
+    // An 8 wide block holds exactly one AVX2 iteration
+    simd_level eightWide = best < SIMD_AVX2 ? best : SIMD_AVX2;
+
+    std::cout << "Storage layouts | " << particles << " particles | " << frames << " frames" << std::endl;
+
+    {
+        legacy_columns legacy(particles);
+        for (int i = 0; i < particles; i++) {
+            float f = (float)(i % 997);
+            (*legacy.position)[i]    = glm::vec2(f, -f);
+            (*legacy.speed)[i]       = glm::vec2(1.0f + f * 0.01f, 2.0f);
+            (*legacy.colorBegin)[i]  = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
+            (*legacy.colorEnd)[i]    = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+            (*legacy.scaleEnd)[i]    = glm::vec3(4.5f, 4.5f, 0.0f);
+            (*legacy.currentLife)[i] = 1000.0f;
+            (*legacy.totalLife)[i]   = 1000.0f;
+        }
+        PrintLayout("Vector per column", "Scalar", TimeMs(frames, [&] { legacy.Update(particles, delta); }), particles);
+    }
+
+    {
+        particle_soa_storage soa(particles);
+        FillStorage(soa, particles);
+
+        particle_columns columns;
+        columns.position    = soa.Data<position_column>();
+        columns.prevPosition = soa.Data<prev_position_column>();
+        columns.speed       = soa.Data<speed_column>();
+        columns.colorBegin  = soa.Data<color_begin_column>();
+        columns.colorEnd    = soa.Data<color_end_column>();
+        columns.color       = soa.Data<color_column>();
+        columns.scaleBegin  = soa.Data<scale_begin_column>();
+        columns.scaleEnd    = soa.Data<scale_end_column>();
+        columns.scale       = soa.Data<scale_column>();
+        columns.currentLife = soa.Data<current_life_column>();
+        columns.totalLife   = soa.Data<total_life_column>();
+
+        particle_update_kernel scalar = GetUpdateKernel(SIMD_SCALAR);
+        particle_update_kernel simd   = GetUpdateKernel(best);
+        PrintLayout("SoA arena", "Scalar", TimeMs(frames, [&] { scalar(columns, 0, particles, delta); }), particles);
+        PrintLayout("SoA arena", GetSimdLevelName(best), TimeMs(frames, [&] { simd(columns, 0, particles, delta); }), particles);
+    }
+
+    {
+        particle_storage_layout<8> aosoa(particles);
+        FillStorage(aosoa, particles);
+
+        particle_update_kernel kernel = GetUpdateKernel(eightWide);
+        int blocks = aosoa.GetBlockCount();
+        PrintLayout("AoSoA 8", GetSimdLevelName(eightWide), TimeMs(frames, [&] {
+            for (int b = 0; b < blocks; b++) {
+                int width = particles - b * 8 < 8 ? particles - b * 8 : 8;
+                kernel(BlockColumns(aosoa, b), 0, width, delta);
+            }
+        }), particles);
+    }
+
+    {
+        particle_storage_layout<16> aosoa(particles);
+        FillStorage(aosoa, particles);
+
+        particle_update_kernel kernel = GetUpdateKernel(best);
+        int blocks = aosoa.GetBlockCount();
+        PrintLayout("AoSoA 16", GetSimdLevelName(best), TimeMs(frames, [&] {
+            for (int b = 0; b < blocks; b++) {
+                int width = particles - b * 16 < 16 ? particles - b * 16 : 16;
+                kernel(BlockColumns(aosoa, b), 0, width, delta);
+            }
+        }), particles);
+    }
+
+    return 0;
+}
+
+// Work per timed case, so small sizes repeat enough to be measurable and
+// 10M particles doesn't take minutes
+#define SUITE_PARTICLES_PER_CASE 20000000
+
+struct suite_result
+{
+    const char* name;
+    const char* scenario;
+    int particles;
+    int iterations;
+    double seconds;
+    long long processed; // particles touched over all iterations
+    int bytesPerParticle;
+};
+
+static particle_data SuiteData(float life)
+{
+    particle_data data = {};
+    data.speed             = glm::vec2(1, 1);
+    data.colorBegin        = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
+    data.colorEnd          = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+    data.scaleBegin        = glm::vec2(0.0f, 0.0f);
+    data.scaleEnd          = glm::vec2(4.5f, 4.5f);
+    data.totalLife         = life;
+    data.emitQuantity      = 1;
+    data.emissionFrequency = 1.0f;
+    return data;
+}
+
+// Bytes moved per particle, summed from the column types so the estimates
+// follow the storage layout. Columns that are read and written are listed
+// twice.
+
+// Every 2D column, what a spawn writes and a reorder gathers
+static int SpawnBytes()
+{
+    return particle_soa_storage::ParticleBytes - ColumnBytes<position_z_column, prev_position_z_column, speed_z_column>();
+}
+
+// The lerping update kernel, reads then writes
+static int UpdateBytes()
+{
+    return ColumnBytes<
+        position_column, speed_column, color_begin_column, color_end_column,
+        scale_begin_column, scale_end_column, current_life_column, total_life_column,
+        position_column, prev_position_column, color_column, scale_column, current_life_column>();
+}
+
+// The lifetime table kernel, reads then writes
+static int LifetimeUpdateBytes()
+{
+    return ColumnBytes<
+        position_column, speed_column, current_life_column, inverse_life_column,
+        position_column, prev_position_column, color_column, scale_column, current_life_column, age_column>();
+}
+
+// What WriteInstances reads, without the interpolation
+static int InstanceSourceBytes()
+{
+    return ColumnBytes<position_column, scale_column, color_column>();
+}
+
+// A key and an index, the element of every sort
+static int SortElementBytes()
+{
+    return (int)(sizeof(uint32_t) + sizeof(int));
+}
+
+// The grid build reads the positions and writes a cell, an index and a
+// position per particle
+static int GridBuildBytes()
+{
+    return ColumnBytes<position_column>() + (int)(2 * sizeof(int) + sizeof(glm::vec2));
+}
+
+template <typename Fn>
+static suite_result TimeCase(const char* name, const char* scenario, int particles, int iterations, int bytesPerParticle, Fn fn)
+{
+    // fn returns how many particles it touched, the first call warms up
+    fn();
+    long long processed = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        processed += fn();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    suite_result result = { name, scenario, particles, iterations, std::chrono::duration<double>(end - start).count(), processed, bytesPerParticle };
+    return result;
+}
+
+static void RunSuiteSize(int particles, job_system& jobs, std::vector<suite_result>& results)
+{
+    int iterations = SUITE_PARTICLES_PER_CASE / particles;
+    iterations = iterations < 3 ? 3 : (iterations > 200 ? 200 : iterations);
+    timestep frame = 1.0f / 60.0f;
+
+    particle_system p(particles);
+    p.jobSystem = &jobs;
+
+    // Spawning. CreateParticle is the one-at-a-time path of non-looping
+    // emitters, ParticleBurst the batched one with every attribute random
+    p.particleData = SuiteData(1000.0f);
+    results.push_back(TimeCase("CreateParticle", "burst", particles, iterations, SpawnBytes(), [&]() {
+        p.ClearParticles();
+        for (int i = 0; i < particles; i++) {
+            p.CreateParticle(p.particleData);
+        }
+        return (long long)particles;
+    }));
+
+    p.SetRandom(POSITION, true);
+    p.SetRandom(SPEED, true);
+    p.SetRandom(TOTAL_LIFE, true);
+    p.rDistr.lifeRange = glm::vec2(900.0f, 1000.0f);
+    results.push_back(TimeCase("ParticleBurst", "burst", particles, iterations, SpawnBytes(), [&]() {
+        p.ClearParticles();
+        p.ParticleBurst(particles);
+        return (long long)particles;
+    }));
+
+    // One draw of the emitter's random settings per call, as a non-looping
+    // emitter would before each CreateParticle
+    results.push_back(TimeCase("RandomizeParticleAttributes", "burst", particles, iterations, (int)sizeof(particle_data), [&]() {
+        for (int i = 0; i < particles; i++) {
+            p.RandomizeParticleAttributes();
+            p.spawnSerial++;
+        }
+        return (long long)particles;
+    }));
+
+    // Steady state: a full system where nothing dies
+    p.ClearParticles();
+    p.ParticleBurst(particles);
+    results.push_back(TimeCase("Update", "steady", particles, iterations, UpdateBytes(), [&]() {
+        int active = p.GetActiveParticles();
+        p.Update(frame);
+        return (long long)active;
+    }));
+
+    // The same in 3D. IntegrateDepth also reads z and its speed and writes
+    // z and the previous z
+    p.space = SPACE_3D;
+    p.ClearParticles();
+    p.ParticleBurst(particles);
+    int depthBytes = ColumnBytes<position_z_column, speed_z_column, position_z_column, prev_position_z_column>();
+    results.push_back(TimeCase("Update", "3d", particles, iterations, UpdateBytes() + depthBytes, [&]() {
+        int active = p.GetActiveParticles();
+        p.Update(frame);
+        return (long long)active;
+    }));
+    p.space = SPACE_2D;
+    p.ClearParticles();
+    p.ParticleBurst(particles);
+
+    // The same with one of every affector on the stack. Each pass reads and
+    // writes the speeds, and the radial ones also read the positions
+    {
+        particle_affector affector;
+        affector.vector = glm::vec2(0.0f, 100.0f);
+        affector.center = glm::vec2(500.0f, 500.0f);
+        affector.radius = 400.0f;
+        for (int type = 0; type < AFFECTOR_TYPE_COUNT; type++) {
+            affector.type     = (affector_type)type;
+            affector.strength = type == AFFECTOR_POINT || type == AFFECTOR_VORTEX ? 1000.0f : 0.5f;
+            p.affectors.push_back(affector);
+        }
+    }
+    int affectorBytes = AFFECTOR_TYPE_COUNT * ColumnBytes<speed_column, speed_column>() + 3 * ColumnBytes<position_column>();
+    results.push_back(TimeCase("Update", "affectors", particles, iterations, UpdateBytes() + affectorBytes, [&]() {
+        int active = p.GetActiveParticles();
+        p.Update(frame);
+        return (long long)active;
+    }));
+    p.affectors.clear();
+
+    // Four color stops and an alpha and scale curve, sampled from the baked
+    // tables. The begin/end columns aren't read, and the tables stay in L1
+    p.lifetime = MakeLinearLifetime(p.particleData.colorBegin, p.particleData.colorEnd);
+    p.lifetime.enabled = true;
+    p.lifetime.color.stops.insert(p.lifetime.color.stops.begin() + 1, { { 0.3f, glm::vec4(1.0f, 1.0f, 0.0f, 1.0f) }, { 0.6f, glm::vec4(0.0f, 1.0f, 0.0f, 1.0f) } });
+    p.lifetime.alpha.keys = { { 0.0f, 0.0f }, { 0.1f, 1.0f }, { 1.0f, 0.0f } };
+    p.BakeLifetime();
+    p.RefreshFeatures();
+    results.push_back(TimeCase("Update", "lifetime", particles, iterations, LifetimeUpdateBytes(), [&]() {
+        int active = p.GetActiveParticles();
+        p.Update(frame);
+        return (long long)active;
+    }));
+    p.lifetime.enabled = false;
+    p.RefreshFeatures();
+
+    // Draw order by depth. The first sort shuffles from spawn order with the
+    // radix sort, after that each Update only fixes what moved. Keys and
+    // indices are written and read, and a reorder gathers every column
+    p.drawSort.key = SORT_DEPTH;
+    results.push_back(TimeCase("Update", "sorted by depth", particles, iterations, UpdateBytes() + 2 * SortElementBytes() + 2 * SpawnBytes(), [&]() {
+        int active = p.GetActiveParticles();
+        p.Update(frame);
+        return (long long)active;
+    }));
+    p.drawSort.key = SORT_NONE;
+
+    // The radix sort alone over unordered keys: each of the four passes
+    // reads and writes a key and an index
+    {
+        std::vector<uint32_t> keys(particles);
+        std::vector<int> values(particles);
+        radix_sorter sorter;
+        results.push_back(TimeCase("radix_sorter::Sort", "shuffled", particles, iterations, 4 * 2 * SortElementBytes(), [&]() {
+            for (int i = 0; i < particles; i++) {
+                keys[i]   = SortableKey(p.position[i].x);
+                values[i] = i;
+            }
+            sorter.Sort(keys.data(), values.data(), particles, p.jobSystem);
+            return (long long)particles;
+        }));
+    }
+
+    std::vector<particle_instance> instances(particles);
+    results.push_back(TimeCase("WriteInstances", "steady", particles, iterations, InstanceSourceBytes() + (int)sizeof(particle_instance), [&]() {
+        int active = p.GetActiveParticles();
+        WriteInstances(p, instances.data(), active, 1.0f);
+        return (long long)active;
+    }));
+    int interpolatedBytes = InstanceSourceBytes() + ColumnBytes<prev_position_column>();
+    results.push_back(TimeCase("WriteInstances (interpolated)", "steady", particles, iterations, interpolatedBytes + (int)sizeof(particle_instance), [&]() {
+        int active = p.GetActiveParticles();
+        WriteInstances(p, instances.data(), active, 0.5f);
+        return (long long)active;
+    }));
+    // The frame comes from the age, so the life and inverse life are read too
+    p.flipbook = { SPRITE_BURST_FIRST, SPRITE_BURST_FRAMES, 1.0f };
+    int flipbookBytes = InstanceSourceBytes() + ColumnBytes<current_life_column, inverse_life_column>();
+    results.push_back(TimeCase("WriteInstances (flipbook)", "steady", particles, iterations, flipbookBytes + (int)sizeof(particle_instance), [&]() {
+        int active = p.GetActiveParticles();
+        WriteInstances(p, instances.data(), active, 1.0f);
+        return (long long)active;
+    }));
+    p.flipbook = particle_flipbook();
+
+    // Culling with the view over the right half of the particles, like an
+    // effect half out of frame. Reads the life too, writes half the instances
+    view_bounds halfView = { glm::vec2(0.0f, -1.0e6f), glm::vec2(1.0e6f, 1.0e6f) };
+    int cullBytes = InstanceSourceBytes() + ColumnBytes<current_life_column>();
+    results.push_back(TimeCase("WriteVisibleInstances", "steady", particles, iterations, cullBytes + (int)sizeof(particle_instance) / 2, [&]() {
+        int active = p.GetActiveParticles();
+        WriteVisibleInstances(p, instances.data(), active, 1.0f, halfView, p.jobSystem);
+        return (long long)active;
+    }));
+
+    // Interaction: the particles spread at about one per collision cell, so
+    // the grid is rebuilt and collisions resolved over a realistic density.
+    // The build reads positions and writes a cell, an index and a position
+    random_distributions steadyDistr = p.rDistr;
+    float side = sqrtf((float)particles) * 2.0f * p.collision.radius;
+    p.rDistr.posXRange = glm::vec2(0.0f, side);
+    p.rDistr.posYRange = glm::vec2(0.0f, side);
+    p.ClearParticles();
+    p.ParticleBurst(particles);
+    results.push_back(TimeCase("spatial_grid::Build", "interaction", particles, iterations, GridBuildBytes(), [&]() {
+        int active = p.GetActiveParticles();
+        p.grid.Build(p.position, active, 2.0f * p.collision.radius, p.jobSystem);
+        return (long long)active;
+    }));
+
+    p.collision.enabled = true;
+    int collisionBytes = GridBuildBytes() + 2 * ColumnBytes<speed_column>();
+    results.push_back(TimeCase("Update", "collisions", particles, iterations, UpdateBytes() + collisionBytes, [&]() {
+        int active = p.GetActiveParticles();
+        p.Update(frame);
+        return (long long)active;
+    }));
+    p.collision.enabled = false;
+    p.rDistr = steadyDistr;
+
+    // Churn: Destroy swaps a tenth of the particles with the last one, then
+    // a burst refills them
+    std::vector<int> victims(particles / 10 > 0 ? particles / 10 : 1);
+    for (size_t v = 0; v < victims.size(); v++) {
+        victims[v] = (int)((v * 2654435761u) % (uint32_t)particles);
+    }
+    results.push_back(TimeCase("Destroy/SwapData", "churn", particles, iterations, 2 * 2 * particle_soa_storage::ParticleBytes, [&]() {
+        for (int v : victims) {
+            p.Destroy(v % (p.lastActiveParticle + 1));
+        }
+        p.ParticleBurst((int)victims.size());
+        return (long long)victims.size();
+    }));
+
+    // High churn: lives of 6 to 12 frames with emission matched to keep the
+    // system near capacity, so every Update compacts ~10% away and respawns
+    // as many
+    p.ClearParticles();
+    p.rDistr.lifeRange = glm::vec2(0.1f, 0.2f);
+    p.particleData = SuiteData(0.15f);
+    p.particleData.emitQuantity = (int)(particles / 0.15f);
+    p.Emit();
+    for (int warm = 0; warm < 30; warm++) {
+        p.Update(frame);
+    }
+    results.push_back(TimeCase("Update", "churn", particles, iterations, UpdateBytes() + SpawnBytes() / 10, [&]() {
+        int active = p.GetActiveParticles();
+        p.Update(frame);
+        return (long long)active;
+    }));
+}
+
+static int RunSuite(int argc, char* argv[])
+{
+    int maxParticles = argc > 2 ? std::atoi(argv[2]) : 10000000;
+    int threads      = argc > 3 ? std::atoi(argv[3]) : 0;
+
+    job_system jobs(threads);
+    std::vector<suite_result> results;
+    for (int particles = 10000; particles <= maxParticles; particles *= 10) {
+        std::cerr << "Benchmarking " << particles << " particles..." << std::endl;
+        RunSuiteSize(particles, jobs, results);
+    }
+
+    std::cout << "{\n"
+              << "  \"simd\": \"" << GetSimdLevelName(DetectSimdLevel()) << "\",\n"
+              << "  \"threads\": " << jobs.GetThreadCount() << ",\n"
+              << "  \"results\": [\n";
+    for (size_t r = 0; r < results.size(); r++) {
+        const suite_result& result = results[r];
+        double nsPerParticle = result.seconds * 1e9 / result.processed;
+        std::cout << "    { \"case\": \"" << result.name << "\""
+                  << ", \"scenario\": \"" << result.scenario << "\""
+                  << ", \"particles\": " << result.particles
+                  << ", \"iterations\": " << result.iterations
+                  << ", \"nsPerParticle\": " << nsPerParticle
+                  << ", \"particlesPerSecond\": " << (long long)(result.processed / result.seconds)
+                  << ", \"bytesPerParticle\": " << result.bytesPerParticle
+                  << " }" << (r + 1 < results.size() ? "," : "") << "\n";
+    }
+    std::cout << "  ]\n}" << std::endl;
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string mode = argc > 1 ? argv[1] : "scaling";
+
+    if (mode == "layouts") {
+        return RunLayouts(argc, argv);
+    }
+    if (mode == "suite") {
+        return RunSuite(argc, argv);
+    }
+    return RunScaling(argc, argv);
+}
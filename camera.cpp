@@ -0,0 +1,55 @@
+#include "camera.h"
+
+#include <cstring>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+glm::vec3 orbit_camera::GetForward() const
+{
+    return glm::vec3(sinf(yaw) * cosf(pitch), sinf(pitch), cosf(yaw) * cosf(pitch));
+}
+
+glm::vec3 orbit_camera::GetPosition(float viewportHeight) const
+{
+    float distance = 0.5f * viewportHeight / tanf(0.5f * fovY) / zoom;
+    return target - GetForward() * distance;
+}
+
+camera_uniforms orbit_camera::GetUniforms(float viewportWidth, float viewportHeight) const
+{
+    camera_uniforms uniforms;
+    // y down, like the 2D projection
+    uniforms.view       = glm::lookAt(GetPosition(viewportHeight), target, glm::vec3(0.0f, -1.0f, 0.0f));
+    uniforms.projection = glm::perspective(fovY, viewportWidth / viewportHeight, nearPlane, farPlane);
+    return uniforms;
+}
+
+void camera_buffer::Init()
+{
+    glGenBuffers(1, &UBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(camera_uniforms), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void camera_buffer::Bind(float width, float height)
+{
+    camera_uniforms uniforms;
+    if (orbit) {
+        uniforms = orbit->GetUniforms(width, height);
+    }
+    else {
+        uniforms.view       = glm::mat4(1.0f);
+        uniforms.projection = glm::ortho(0.0f, width, height, 0.0f);
+    }
+
+    if (!uploaded || memcmp(&uniforms, &current, sizeof(uniforms)) != 0) {
+        current  = uniforms;
+        uploaded = true;
+
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(camera_uniforms), &current);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_UBO_BINDING, UBO);
+}
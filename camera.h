@@ -0,0 +1,49 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+
+// Binding point of the Camera uniform block in the particle shaders
+#define CAMERA_UBO_BINDING 0
+
+// std140 layout of the Camera block
+struct camera_uniforms
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+};
+
+// Perspective camera circling target, for 3D emitters. At yaw = pitch = 0
+// it looks down +z with y pointing down the screen, and zoom 1 frames the
+// z = 0 plane exactly like the 2D projection, so switching to 3D starts
+// from the same picture.
+struct orbit_camera
+{
+	glm::vec3 target = glm::vec3(0.0f);
+	float yaw   = 0.0f; // Radians, around y
+	float pitch = 0.0f; // Radians, keep inside +-pi/2
+	float zoom  = 1.0f;
+	float fovY  = 1.0471976f; // 60 degrees
+	float nearPlane = 1.0f;
+	float farPlane  = 20000.0f;
+
+	glm::vec3 GetForward() const;
+	glm::vec3 GetPosition(float viewportHeight) const;
+	camera_uniforms GetUniforms(float viewportWidth, float viewportHeight) const;
+};
+
+// Owns a Camera uniform block. The matrices are only uploaded when the
+// viewport or the camera changed, not on every draw.
+struct camera_buffer
+{
+	void Init();
+	// Binds the block, uploading new matrices first if they changed
+	void Bind(float width, float height);
+
+	// 2D ortho projection over the viewport while null
+	const orbit_camera* orbit = nullptr;
+
+	GLuint UBO = 0;
+	bool uploaded = false;
+	camera_uniforms current;
+};
@@ -0,0 +1,238 @@
+#include "emitter_manager.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+
+static float MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void emitter_manager::Init(int totalParticles, bool persistentMapping)
+{
+    renderer.Init(totalParticles, persistentMapping);
+
+    freeRanges.clear();
+    freeRanges.push_back({ 0, totalParticles });
+}
+
+particle_system* emitter_manager::CreateEmitter(int maxParticles)
+{
+    // First fit
+    for (size_t r = 0; r < freeRanges.size(); r++) {
+        instance_range& free = freeRanges[r];
+        if (free.count < maxParticles) {
+            continue;
+        }
+
+        managed_emitter emitter;
+        emitter.system = std::make_unique<particle_system>(maxParticles);
+        emitter.range  = { free.first, maxParticles };
+
+        // Otherwise every emitter would spawn the same particles
+        emitter.system->SetSeed(nextSeed++);
+        if (maxParticles >= EMITTER_PARALLEL_THRESHOLD) {
+            emitter.system->jobSystem = jobSystem;
+        }
+
+        free.first += maxParticles;
+        free.count -= maxParticles;
+        if (free.count == 0) {
+            freeRanges.erase(freeRanges.begin() + r);
+        }
+
+        emitters.push_back(std::move(emitter));
+        return emitters.back().system.get();
+    }
+
+    std::cout << "Emitter manager: no room for " << maxParticles << " more particles" << std::endl;
+    return nullptr;
+}
+
+void emitter_manager::DestroyEmitter(particle_system* system)
+{
+    for (size_t e = 0; e < emitters.size(); e++) {
+        if (emitters[e].system.get() == system) {
+            ReleaseRange(emitters[e].range);
+            emitters.erase(emitters.begin() + e);
+            return;
+        }
+    }
+}
+
+void emitter_manager::ReleaseRange(instance_range range)
+{
+    size_t r = 0;
+    while (r < freeRanges.size() && freeRanges[r].first < range.first) {
+        r++;
+    }
+    freeRanges.insert(freeRanges.begin() + r, range);
+
+    // Merge with the next range, then with the previous one
+    if (r + 1 < freeRanges.size() && freeRanges[r].first + freeRanges[r].count == freeRanges[r + 1].first) {
+        freeRanges[r].count += freeRanges[r + 1].count;
+        freeRanges.erase(freeRanges.begin() + r + 1);
+    }
+    if (r > 0 && freeRanges[r - 1].first + freeRanges[r - 1].count == freeRanges[r].first) {
+        freeRanges[r - 1].count += freeRanges[r].count;
+        freeRanges.erase(freeRanges.begin() + r);
+    }
+}
+
+void emitter_manager::GatherSystems()
+{
+    systems.clear();
+    for (managed_emitter& emitter : emitters) {
+        systems.push_back(emitter.system.get());
+    }
+}
+
+void emitter_manager::Update(timestep ts)
+{
+    PROFILE_SCOPE("Emitters update");
+    auto start = std::chrono::steady_clock::now();
+
+    // Large emitters spread their own chunks over the pool
+    for (managed_emitter& emitter : emitters) {
+        if (emitter.system->jobSystem) {
+            emitter.system->Update(ts);
+        }
+    }
+
+    auto updateSmall = [&](int begin, int end) {
+        for (int e = begin; e < end; e++) {
+            if (!emitters[e].system->jobSystem) {
+                emitters[e].system->Update(ts);
+            }
+        }
+    };
+
+    int count = (int)emitters.size();
+    if (jobSystem) {
+        jobSystem->ParallelFor(count, 1, updateSmall);
+    }
+    else {
+        updateSmall(0, count);
+    }
+
+    GatherSystems();
+    governor.Tally(systems);
+    simulationMilliseconds += MillisecondsSince(start);
+}
+
+void emitter_manager::UploadToGPU(float alpha)
+{
+    PROFILE_SCOPE("Emitters upload");
+    auto start = std::chrono::steady_clock::now();
+    particle_instance* dst = renderer.BeginUpload();
+
+    int count = (int)emitters.size();
+    std::vector<instance_range> written(count);
+
+    // Every emitter writes from the start of its own range. The culled
+    // count is only known afterwards
+    auto write = [&](int e, job_system* jobs) {
+        const managed_emitter& emitter = emitters[e];
+        int active = emitter.system->lastActiveParticle + 1;
+        active = active < emitter.range.count ? active : emitter.range.count;
+
+        particle_instance* out = dst + emitter.range.first;
+        if (culling) {
+            active = WriteVisibleInstances(*emitter.system, out, active, alpha, view, jobs);
+        }
+        else {
+            WriteInstances(*emitter.system, out, active, alpha);
+        }
+        written[e] = { emitter.range.first, active };
+    };
+
+    // Same split as Update: large emitters cull across the pool one at a
+    // time, small ones run whole, several in parallel
+    for (int e = 0; e < count; e++) {
+        if (emitters[e].system->jobSystem) {
+            write(e, jobSystem);
+        }
+    }
+
+    auto writeSmall = [&](int begin, int end) {
+        for (int e = begin; e < end; e++) {
+            if (!emitters[e].system->jobSystem) {
+                write(e, nullptr);
+            }
+        }
+    };
+
+    if (jobSystem) {
+        jobSystem->ParallelFor(count, 1, writeSmall);
+    }
+    else {
+        writeSmall(0, count);
+    }
+
+    // Drawn by layer, then in buffer order, so both paths blend the same way
+    std::vector<int> order(count);
+    for (int e = 0; e < count; e++) {
+        order[e] = e;
+    }
+    auto bufferOrder = [&](int a, int b) { return written[a].first < written[b].first; };
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        int layerA = emitters[a].system->drawSort.layer;
+        int layerB = emitters[b].system->drawSort.layer;
+        return layerA != layerB ? layerA < layerB : bufferOrder(a, b);
+    });
+
+    // The GL 4.1 fallback draws one instanced range from 0, so emitters are
+    // packed back to back there. Going up the buffer, a range only ever
+    // moves down over space already packed. With one emitter nothing moves.
+    // Layers out of buffer order go through packScratch instead
+    if (!renderer.IsPersistentMapped()) {
+        bool inPlace = std::is_sorted(order.begin(), order.end(), bufferOrder);
+        if (!inPlace) {
+            packScratch.clear();
+        }
+        int next = 0;
+        for (int e : order) {
+            const particle_instance* src = dst + written[e].first;
+            if (!inPlace) {
+                packScratch.insert(packScratch.end(), src, src + written[e].count);
+            }
+            else if (written[e].first != next) {
+                std::copy(src, src + written[e].count, dst + next);
+            }
+            written[e].first = next;
+            next += written[e].count;
+        }
+        if (!inPlace) {
+            std::copy(packScratch.begin(), packScratch.end(), dst);
+        }
+    }
+
+    visibleParticles = 0;
+    for (int e : order) {
+        renderer.AddDraw(written[e].first, written[e].count);
+        visibleParticles += written[e].count;
+    }
+    renderer.EndUpload();
+    uploadMilliseconds = MillisecondsSince(start);
+
+    render_stats renderStats = renderer.GetStats();
+    float gpuMilliseconds = renderStats.gpuUploadMilliseconds + renderStats.gpuDrawMilliseconds;
+    GatherSystems();
+    governor.Update(simulationMilliseconds + uploadMilliseconds + gpuMilliseconds, systems);
+    simulationMilliseconds = 0.0f;
+}
+
+void emitter_manager::Render()
+{
+    renderer.Render();
+}
+
+int emitter_manager::GetActiveParticles()
+{
+    int active = 0;
+    for (managed_emitter& emitter : emitters) {
+        active += emitter.system->GetActiveParticles();
+    }
+    return active;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cfloat>
+#include <memory>
+#include <vector>
+#include "timestep.h"
+#include "particle_system.h"
+#include "particle_renderer.h"
+#include "job_system.h"
+#include "frame_governor.h"
+
+// Emitters at or above this capacity split their own update across the
+// job system. Smaller ones are updated whole, several in parallel.
+#define EMITTER_PARALLEL_THRESHOLD (4 * UPDATE_CHUNK_SIZE)
+
+// Slice [first, first + count) of the shared instance buffer
+struct instance_range
+{
+	int first;
+	int count;
+};
+
+struct managed_emitter
+{
+	std::unique_ptr<particle_system> system;
+	instance_range range;
+};
+
+// Owns many emitters and draws them through one particle_renderer: one
+// shader, one VAO, one instance buffer and a single draw call however many
+// emitters there are. Each emitter is given a fixed range of the instance
+// buffer sized to its capacity, so emitters upload independently of each
+// other.
+struct emitter_manager
+{
+	void Init(int totalParticles, bool persistentMapping = true);
+	// nullptr when the shared instance buffer has no room left
+	particle_system* CreateEmitter(int maxParticles);
+	void DestroyEmitter(particle_system* emitter);
+
+	void Update(timestep ts);
+	// Writes every emitter's instances, only those overlapping view when
+	// culling is set, and queues their draws by ascending drawSort.layer
+	void UploadToGPU(float alpha = 1.0f);
+	void Render();
+
+	int GetActiveParticles();
+	inline int GetEmitterCount() { return (int)emitters.size(); };
+
+	particle_renderer renderer;
+	std::vector<managed_emitter> emitters;
+	// Unused parts of the instance buffer, sorted and coalesced
+	std::vector<instance_range> freeRanges;
+
+	// Set by the owner every frame. Until then only dead particles are culled
+	view_bounds view = { glm::vec2(-FLT_MAX), glm::vec2(FLT_MAX) };
+	bool culling = true;
+	// Instances written by the last upload
+	int visibleParticles = 0;
+	// Fallback packing when layers aren't in buffer order
+	std::vector<particle_instance> packScratch;
+
+	// Fed at the end of every upload with the CPU time of the updates since
+	// the last one and of the upload, plus the latest GPU upload and draw
+	// times. Its budgets apply from the next Update
+	frame_governor governor;
+	float simulationMilliseconds = 0.0f;
+	float uploadMilliseconds = 0.0f;
+	// Every emitter's system, for the governor
+	std::vector<particle_system*> systems;
+
+	// Optional, runs single threaded when null
+	job_system* jobSystem = nullptr;
+	uint64_t nextSeed = PARTICLE_RANDOM_DEFAULT_SEED;
+
+private:
+	void ReleaseRange(instance_range range);
+	void GatherSystems();
+};
@@ -0,0 +1,98 @@
+#include "frame_governor.h"
+
+#include <algorithm>
+
+static void Accumulate(emission_stats& sum, const emission_stats& add)
+{
+    sum.owed      += add.owed;
+    sum.spawned   += add.spawned;
+    sum.shed      += add.shed;
+    sum.refused   += add.refused;
+    sum.decimated += add.decimated;
+}
+
+void frame_governor::Tally(const std::vector<particle_system*>& systems)
+{
+    for (const particle_system* system : systems) {
+        Accumulate(pending, system->emissionStats);
+    }
+}
+
+void frame_governor::Update(float milliseconds, const std::vector<particle_system*>& systems)
+{
+    stats.frame = pending;
+    pending = emission_stats();
+
+    if (!settings.enabled || settings.targetMilliseconds <= 0.0f) {
+        // Budgets set by hand are left alone, only the governor's own are
+        // lifted when it's switched off
+        for (particle_system* system : systems) {
+            if (engaged) {
+                system->budget.emitScale   = 1.0f;
+                system->budget.particleCap = INT_MAX;
+                system->budget.decimate    = false;
+            }
+            system->budget.unthrottledCount = system->GetActiveParticles();
+        }
+        engaged = false;
+        stats.frameMilliseconds = milliseconds;
+        stats.pressure          = 0.0f;
+        stats.throttledEmitters = 0;
+        stats.totalShed         = 0;
+        stats.totalRefused      = 0;
+        stats.totalDecimated    = 0;
+        return;
+    }
+
+    engaged = true;
+    stats.totalShed      += stats.frame.shed;
+    stats.totalRefused   += stats.frame.refused;
+    stats.totalDecimated += stats.frame.decimated;
+
+    float previous = stats.frameMilliseconds;
+    stats.frameMilliseconds += (milliseconds - stats.frameMilliseconds) * GOVERNOR_SMOOTHING;
+
+    levels.clear();
+    for (const particle_system* system : systems) {
+        levels.push_back(system->budget.priority);
+    }
+    std::sort(levels.begin(), levels.end());
+    levels.erase(std::unique(levels.begin(), levels.end()), levels.end());
+
+    // Throttled particles live out their lives, so the cost falls some time
+    // after the emission does. Pressure only builds while the cost isn't
+    // already falling, or it would keep rising through that delay
+    float error = stats.frameMilliseconds / settings.targetMilliseconds - 1.0f;
+    if (error > 0.0f && stats.frameMilliseconds >= previous) {
+        stats.pressure += settings.attack * error;
+    }
+    else if (error < -settings.hysteresis) {
+        stats.pressure += settings.release * error;
+    }
+    float maxPressure = (float)levels.size();
+    stats.pressure = stats.pressure < 0.0f ? 0.0f : (stats.pressure > maxPressure ? maxPressure : stats.pressure);
+
+    stats.throttledEmitters = 0;
+    for (particle_system* system : systems) {
+        emission_budget& budget = system->budget;
+        int level = (int)(std::lower_bound(levels.begin(), levels.end(), budget.priority) - levels.begin());
+        float throttle = stats.pressure - (float)level;
+        throttle = throttle < 0.0f ? 0.0f : (throttle > 1.0f ? 1.0f : throttle);
+
+        if (throttle <= 0.0f) {
+            budget.emitScale        = 1.0f;
+            budget.particleCap      = INT_MAX;
+            budget.decimate         = false;
+            budget.unthrottledCount = system->GetActiveParticles();
+            continue;
+        }
+
+        // An emitter that was never seen unthrottled has nothing to scale
+        // the cap from and is only slowed down
+        float scale = 1.0f - throttle * (1.0f - settings.minScale);
+        budget.emitScale   = scale;
+        budget.particleCap = budget.unthrottledCount > 0 ? (int)(scale * budget.unthrottledCount) : INT_MAX;
+        budget.decimate    = settings.decimate;
+        stats.throttledEmitters++;
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include "particle_system.h"
+
+// Weight of the newest frame in the smoothed cost. A single slow frame
+// moves it a quarter of the way, a sustained overrun within a few frames
+#define GOVERNOR_SMOOTHING 0.25f
+
+struct governor_settings
+{
+	bool enabled = false;
+	// Simulation, upload and draw of every emitter, per rendered frame
+	float targetMilliseconds = 4.0f;
+	// Lowest emitScale and cap fraction an emitter is throttled to
+	float minScale = 0.1f;
+	// Also removes live particles over the lowered caps, see emission_budget
+	bool decimate = false;
+	// Pressure added per frame and per unit of overrun (1 at twice the
+	// target), and removed per unit of headroom once the cost is below
+	// (1 - hysteresis) of the target. Backing off slower than throttling
+	// keeps it from oscillating while throttled particles die out
+	float attack = 0.5f;
+	float release = 0.05f;
+	float hysteresis = 0.1f;
+};
+
+struct governor_stats
+{
+	float frameMilliseconds = 0.0f; // Smoothed cost the governor acts on
+	float pressure = 0.0f;
+	int throttledEmitters = 0;
+	// Summed over every emitter and update since the last frame
+	emission_stats frame;
+	// Since Init, or since the governor was enabled
+	long long totalShed = 0;
+	long long totalRefused = 0;
+	long long totalDecimated = 0;
+};
+
+// Holds the particle cost of a frame near a target by setting every
+// emitter's budget. Pressure rises while over the target and falls while
+// under it, and is spent on the emitters one priority level at a time,
+// lowest first: with pressure p, level k (0 the lowest) runs at
+// 1 - clamp(p - k, 0, 1) * (1 - minScale) of its emission rate and of the
+// particles it had unthrottled. Higher priorities are only touched once
+// every lower one is at minScale.
+struct frame_governor
+{
+	// Adds the last updates' emission_stats to stats.frame. Call after
+	// every update of the emitters
+	void Tally(const std::vector<particle_system*>& systems);
+	// Takes one frame's measured cost and sets the budgets the next updates
+	// run under. Turning it off resets the budgets to unthrottled
+	void Update(float milliseconds, const std::vector<particle_system*>& systems);
+
+	governor_settings settings;
+	governor_stats stats;
+	// Emission of the frame being tallied
+	emission_stats pending;
+	// Budgets were set by the last Update
+	bool engaged = false;
+
+	// Distinct priorities, ascending. Scratch for Update
+	std::vector<int> levels;
+};
@@ -0,0 +1,171 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "particle_system.h"
+#include "particle_compute.h"
+#include "window.h"
+
+window* window::s_Instance = nullptr;
+
+// Every column the two backends share, in gpu_particle order
+struct particle_record
+{
+    float values[24];
+};
+
+static particle_record RecordOf(const particle_system& p, int i)
+{
+    const float* columns[] = {
+        (const float*)&p.position[i], (const float*)&p.speed[i],
+        (const float*)&p.colorBegin[i], (const float*)&p.colorEnd[i], (const float*)&p.color[i],
+        (const float*)&p.scaleBegin[i], (const float*)&p.scaleEnd[i], (const float*)&p.scale[i],
+        &p.currentLife[i], &p.totalLife[i]
+    };
+    const int widths[] = { 2, 2, 4, 4, 4, 2, 2, 2, 1, 1 };
+
+    particle_record record;
+    int k = 0;
+    for (int c = 0; c < 10; c++) {
+        for (int w = 0; w < widths[c]; w++) {
+            record.values[k++] = columns[c][w];
+        }
+    }
+    return record;
+}
+
+static particle_record RecordOf(const gpu_particle& g)
+{
+    static_assert(sizeof(particle_record) == sizeof(gpu_particle), "particle_record must cover every gpu_particle column");
+    particle_record record;
+    memcpy(record.values, &g, sizeof(record.values));
+    return record;
+}
+
+// Bitwise, so the order is total and the same on both sides
+static bool RecordLess(const particle_record& a, const particle_record& b)
+{
+    return memcmp(&a, &b, sizeof(particle_record)) < 0;
+}
+
+static void SetUp(particle_system& emitter)
+{
+    particle_data data = {};
+    data.position          = glm::vec2(128.0f, 128.0f);
+    data.speed             = glm::vec2(3.0f, 3.0f);
+    data.colorBegin        = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
+    data.colorEnd          = glm::vec4(0.0f, 0.0f, 1.0f, 0.5f);
+    data.scaleBegin        = glm::vec2(4.0f, 4.0f);
+    data.scaleEnd          = glm::vec2(8.0f, 8.0f);
+    data.totalLife         = 0.5f;
+    data.emitQuantity      = 3000;
+    data.emissionFrequency = 1.0f;
+
+    emitter.particleData = data;
+    emitter.looping      = true;
+    emitter.rDistr.lifeRange = glm::vec2(0.1f, 0.8f);
+    emitter.SetRandom(SPEED, true);
+    emitter.SetRandom(TOTAL_LIFE, true);
+    emitter.SetSeed(PARTICLE_RANDOM_DEFAULT_SEED);
+}
+
+// Runs the same seeded emitter on the CPU and on the compute backend and
+// compares every particle bit for bit. The GPU keeps particles in a
+// different order, so both sides are sorted first. Needs GL 4.3, e.g. Mesa
+// llvmpipe with LIBGL_ALWAYS_SOFTWARE=1.
+// Usage: particles_gpu_parity [frames] [maxParticles]
+// Exits with 0 when the backends match, 1 when they differ and 2 without a
+// usable context
+int main(int argc, char* argv[])
+{
+    int frames       = argc > 1 ? std::atoi(argv[1]) : 60;
+    int maxParticles = argc > 2 ? std::atoi(argv[2]) : 2000;
+
+    // Hidden, only the context is needed
+    glfwInit();
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    window_props windowProps;
+    windowProps.width  = 256;
+    windowProps.height = 256;
+    windowProps.title  = "Particle GPU parity";
+    window window;
+    window.Init(windowProps);
+    if (window.m_Window == nullptr || !gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        std::cout << "No GL context" << std::endl;
+        return 2;
+    }
+
+    timestep ts = 1.0f / 60.0f;
+
+    particle_system cpu(maxParticles);
+    SetUp(cpu);
+    cpu.ParticleBurst(maxParticles / 4);
+    cpu.Emit();
+    for (int frame = 0; frame < frames; frame++) {
+        cpu.Update(ts);
+    }
+
+    // The compute backend takes its emission and random draws from this
+    // emitter, whose own columns stay unused
+    particle_system emitter(maxParticles);
+    SetUp(emitter);
+    particle_compute_system gpu;
+    if (!gpu.Init(emitter)) {
+        return 2;
+    }
+    gpu.ParticleBurst(maxParticles / 4);
+    emitter.Emit();
+    for (int frame = 0; frame < frames; frame++) {
+        gpu.Update(ts);
+    }
+
+    std::vector<gpu_particle> readBack;
+    gpu.ReadBackParticles(readBack);
+
+    std::vector<particle_record> expected;
+    std::vector<particle_record> actual;
+    for (int i = 0; i < cpu.GetActiveParticles(); i++) {
+        expected.push_back(RecordOf(cpu, i));
+    }
+    for (const gpu_particle& particle : readBack) {
+        actual.push_back(RecordOf(particle));
+    }
+    std::sort(expected.begin(), expected.end(), RecordLess);
+    std::sort(actual.begin(), actual.end(), RecordLess);
+
+    std::cout << "Kernel: " << GetSimdLevelName(cpu.simdLevel)
+              << " | Frames: " << frames
+              << " | CPU particles: " << expected.size()
+              << " | GPU particles: " << actual.size() << std::endl;
+    if (expected.size() != actual.size()) {
+        std::cout << "FAIL: particle counts differ" << std::endl;
+        return 1;
+    }
+
+    int mismatches = 0;
+    float maxError = 0.0f;
+    for (size_t i = 0; i < expected.size(); i++) {
+        if (memcmp(&expected[i], &actual[i], sizeof(particle_record)) == 0) {
+            continue;
+        }
+        mismatches++;
+        for (int k = 0; k < 24; k++) {
+            maxError = std::max(maxError, fabsf(expected[i].values[k] - actual[i].values[k]));
+        }
+    }
+
+    GLenum error = glGetError();
+    if (mismatches > 0 || error != GL_NO_ERROR) {
+        std::cout << "FAIL: " << mismatches << " particles differ, max error " << maxError
+                  << ", GL error 0x" << std::hex << error << std::endl;
+        return 1;
+    }
+    std::cout << "OK: every particle matches bit for bit" << std::endl;
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include "gpu_timer.h"
+
+void gpu_timer::Init()
+{
+    // Timer queries are GL 3.3 core
+    supported = GLAD_GL_VERSION_3_3;
+    if (!supported) {
+        return;
+    }
+    glGenQueries(GPU_TIMER_FRAMES * GPU_TIMER_SCOPES, &queries[0][0]);
+}
+
+void gpu_timer::Begin(gpu_timer_scope scope)
+{
+    if (!supported) {
+        return;
+    }
+
+    // Reusing a query whose result hasn't been read would wait on it, so
+    // this frame goes unmeasured instead
+    skipped[scope] = pending[frame][scope];
+    if (skipped[scope]) {
+        skippedQueries++;
+        return;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, queries[frame][scope]);
+}
+
+void gpu_timer::End(gpu_timer_scope scope)
+{
+    if (!supported || skipped[scope]) {
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[frame][scope] = true;
+}
+
+void gpu_timer::EndFrame()
+{
+    if (!supported) {
+        return;
+    }
+
+    // Oldest frame first, so the newest ready result is the one kept
+    for (int f = 1; f <= GPU_TIMER_FRAMES; f++) {
+        int slot = (frame + f) % GPU_TIMER_FRAMES;
+        for (int s = 0; s < GPU_TIMER_SCOPES; s++) {
+            if (!pending[slot][s]) {
+                continue;
+            }
+
+            GLint available = 0;
+            glGetQueryObjectiv(queries[slot][s], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                continue;
+            }
+
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(queries[slot][s], GL_QUERY_RESULT, &ns);
+            lastMilliseconds[s] = (float)(ns / 1e6);
+            pending[slot][s] = false;
+        }
+    }
+
+    frame = (frame + 1) % GPU_TIMER_FRAMES;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Frames of queries in flight. Results are read two frames late, by which
+// time the GPU is normally done with them, so polling never has to wait.
+#define GPU_TIMER_FRAMES 3
+
+enum gpu_timer_scope
+{
+	GPU_TIMER_UPLOAD,
+	GPU_TIMER_DRAW,
+	GPU_TIMER_SCOPES
+};
+
+// GL_TIME_ELAPSED queries around whole scopes of GL work. Only one scope can
+// be open at a time, since GL allows a single active elapsed-time query.
+struct gpu_timer
+{
+	void Init();
+
+	void Begin(gpu_timer_scope scope);
+	void End(gpu_timer_scope scope);
+	// Collects whatever results are ready and moves on to the next set of
+	// queries. Call once per frame, after the last End
+	void EndFrame();
+
+	// Latest completed measurement, 0 until the first one arrives
+	inline float GetMilliseconds(gpu_timer_scope scope) { return lastMilliseconds[scope]; };
+	inline bool IsSupported() { return supported; };
+
+	bool supported = false;
+	int frame = 0;
+	GLuint queries[GPU_TIMER_FRAMES][GPU_TIMER_SCOPES] = {};
+	bool pending[GPU_TIMER_FRAMES][GPU_TIMER_SCOPES] = {};
+	// Begin skipped the query because its last result was still in flight
+	bool skipped[GPU_TIMER_SCOPES] = {};
+
+	// Stats
+	float lastMilliseconds[GPU_TIMER_SCOPES] = {};
+	long long skippedQueries = 0;
+};
@@ -0,0 +1,55 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include "particle_system.h"
+
+// Steps the simulation without creating a window or GL context.
+// Usage: particles_headless [maxParticles] [frames] [frameMs] [threads]
+int main(int argc, char* argv[])
+{
+    int maxParticles = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    int frames       = argc > 2 ? std::atoi(argv[2]) : 600;
+    float frameMs    = argc > 3 ? (float)std::atof(argv[3]) : 1000.0f / 60.0f;
+    int threads      = argc > 4 ? std::atoi(argv[4]) : 0;
+
+    particle_data data = {};
+    data.position          = glm::vec2(0.0f, 0.0f);
+    data.speed             = glm::vec2(1, 1);
+    data.colorBegin        = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
+    data.colorEnd          = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+    data.scaleBegin        = glm::vec2(0.0f, 0.0f);
+    data.scaleEnd          = glm::vec2(4.5f, 4.5f);
+    data.totalLife         = 3;
+    data.emitQuantity      = maxParticles;
+    data.emissionFrequency = 10.0f;
+
+    job_system jobs(threads);
+
+    particle_system particleSystem(maxParticles);
+    particleSystem.jobSystem = &jobs;
+    particleSystem.particleData = data;
+    particleSystem.looping = true;
+
+    particleSystem.ParticleBurst(maxParticles / 2);
+    particleSystem.Emit();
+
+    timestep ts = frameMs / 1000.0f;
+    double totalMs = 0.0;
+
+    for (int frame = 0; frame < frames; frame++) {
+        auto start = std::chrono::steady_clock::now();
+        particleSystem.Update(ts);
+        auto end = std::chrono::steady_clock::now();
+
+        totalMs += std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    std::cout << "Kernel: " << GetSimdLevelName(particleSystem.simdLevel)
+              << " | Threads: " << jobs.GetThreadCount()
+              << " | Frames: " << frames
+              << " | Active particles: " << particleSystem.GetActiveParticles()
+              << " | Ms / update: " << (frames > 0 ? totalMs / frames : 0.0) << std::endl;
+
+    return 0;
+}
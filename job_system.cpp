@@ -0,0 +1,156 @@
+#include "job_system.h"
+#include "profiler.h"
+
+job_system::job_system(int threadCount)
+{
+    StartThreads(threadCount);
+}
+
+job_system::~job_system()
+{
+    StopThreads();
+}
+
+void job_system::SetThreadCount(int threadCount)
+{
+    StopThreads();
+    StartThreads(threadCount);
+}
+
+void job_system::StartThreads(int threadCount)
+{
+    if (threadCount <= 0) {
+        threadCount = (int)std::thread::hardware_concurrency();
+    }
+    if (threadCount <= 0) {
+        threadCount = 1;
+    }
+
+    quit = false;
+    queues.clear();
+    for (int i = 0; i < threadCount; i++) {
+        queues.push_back(std::make_unique<job_queue>());
+    }
+
+    // Queue 0 belongs to the submitting thread
+    for (int i = 1; i < threadCount; i++) {
+        threads.emplace_back(&job_system::WorkerLoop, this, i);
+    }
+}
+
+void job_system::StopThreads()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        quit = true;
+    }
+    wake.notify_all();
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+}
+
+void job_system::ParallelFor(int count, int chunkSize, const std::function<void(int, int)>& fn)
+{
+    if (count <= 0) {
+        return;
+    }
+    if (chunkSize <= 0) {
+        chunkSize = count;
+    }
+
+    int chunks = (count + chunkSize - 1) / chunkSize;
+
+    if (threads.empty() || chunks == 1) {
+        for (int begin = 0; begin < count; begin += chunkSize) {
+            fn(begin, begin + chunkSize < count ? begin + chunkSize : count);
+        }
+        return;
+    }
+
+    std::atomic<int> remaining(chunks);
+
+    // Deal chunks round-robin so every deque starts with a share
+    int queueCount = (int)queues.size();
+    for (int q = 0; q < queueCount; q++) {
+        std::lock_guard<std::mutex> lock(queues[q]->mutex);
+        for (int c = q; c < chunks; c += queueCount) {
+            int begin = c * chunkSize;
+            int end   = begin + chunkSize < count ? begin + chunkSize : count;
+            queues[q]->jobs.push_back({ &fn, begin, end, &remaining });
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        pendingJobs += chunks;
+    }
+    wake.notify_all();
+
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        if (!RunOne(0)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void job_system::WorkerLoop(int index)
+{
+    while (true) {
+        if (RunOne(index)) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return quit || pendingJobs.load() > 0; });
+        if (quit) {
+            return;
+        }
+    }
+}
+
+bool job_system::RunOne(int index)
+{
+    job j;
+    if (!TryPop(index, j) && !TrySteal(index, j)) {
+        return false;
+    }
+
+    pendingJobs--;
+    {
+        PROFILE_SCOPE("Job");
+        (*j.fn)(j.begin, j.end);
+    }
+    j.remaining->fetch_sub(1, std::memory_order_release);
+    return true;
+}
+
+bool job_system::TryPop(int index, job& out)
+{
+    job_queue& queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.jobs.empty()) {
+        return false;
+    }
+
+    out = queue.jobs.back();
+    queue.jobs.pop_back();
+    return true;
+}
+
+bool job_system::TrySteal(int index, job& out)
+{
+    int queueCount = (int)queues.size();
+    for (int i = 1; i < queueCount; i++) {
+        job_queue& victim = *queues[(index + i) % queueCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            out = victim.jobs.front();
+            victim.jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads with one deque per thread. Owners pop from
+// the back of their own deque, idle threads steal from the front of others.
+// ParallelFor blocks and the calling thread works too, so a pool of N
+// threads spawns N - 1 workers. Only one thread should submit at a time.
+struct job_system
+{
+	// 0 uses every hardware thread
+	job_system(int threadCount = 0);
+	~job_system();
+
+	job_system(const job_system&) = delete;
+	job_system& operator=(const job_system&) = delete;
+
+	void SetThreadCount(int threadCount);
+	inline int GetThreadCount() { return (int)queues.size(); };
+
+	// Calls fn(begin, end) for consecutive chunks of [0, count). Chunks are
+	// disjoint, so an element-wise fn gives the same result for any thread count
+	void ParallelFor(int count, int chunkSize, const std::function<void(int, int)>& fn);
+
+private:
+	struct job
+	{
+		const std::function<void(int, int)>* fn;
+		int begin;
+		int end;
+		std::atomic<int>* remaining;
+	};
+
+	struct job_queue
+	{
+		std::mutex mutex;
+		std::deque<job> jobs;
+	};
+
+	void StartThreads(int threadCount);
+	void StopThreads();
+	void WorkerLoop(int index);
+	bool RunOne(int index);
+	bool TryPop(int index, job& out);
+	bool TrySteal(int index, job& out);
+
+	std::vector<std::unique_ptr<job_queue>> queues;
+	std::vector<std::thread> threads;
+
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	std::atomic<int> pendingJobs{ 0 };
+	bool quit = false;
+};
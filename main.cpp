@@ -13,14 +13,94 @@
 #include <string>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <vector>
 
 #include "window.h"
 #include "Shader.h"
 #include "particle_system.h"
+#include "particle_renderer.h"
+#include "emitter_manager.h"
+#include "particle_compute.h"
+#include "profiler.h"
+
+#define MAIN_EMITTER_PARTICLES  10000
+#define MAX_EXTRA_EMITTERS      256
+#define EXTRA_EMITTER_PARTICLES 1000
+
+#define PROFILER_LANE_HEIGHT 18.0f
+#define PROFILER_TRACE_PATH  "particles_trace.json"
+#define CURVE_PREVIEW_SAMPLES 64
 
 float lastTime = 0;
 window* window::s_Instance = nullptr;
 
+// Stop list editors for the lifetime panel, true when anything changed and
+// the tables need baking again
+static bool EditGradient(const char* label, particle_gradient& gradient)
+{
+    bool changed = false;
+    ImGui::PushID(label);
+    ImGui::Text("%s", label);
+    for (size_t s = 0; s < gradient.stops.size(); s++) {
+        ImGui::PushID((int)s);
+        ImGui::PushItemWidth(120.0f);
+        changed |= ImGui::SliderFloat("##age", &gradient.stops[s].age, 0.0f, 1.0f, "age %.2f");
+        ImGui::PopItemWidth();
+        ImGui::SameLine();
+        changed |= ImGui::ColorEdit4("##color", (float*)&gradient.stops[s].color, ImGuiColorEditFlags_NoInputs);
+        ImGui::SameLine();
+        bool remove = gradient.stops.size() > 1 && ImGui::Button("Remove");
+        ImGui::PopID();
+        if (remove) {
+            gradient.stops.erase(gradient.stops.begin() + s);
+            changed = true;
+            break;
+        }
+    }
+    if (ImGui::Button("Add stop")) {
+        gradient.stops.push_back({ 1.0f, gradient.Evaluate(1.0f) });
+        changed = true;
+    }
+    ImGui::PopID();
+    return changed;
+}
+
+static bool EditCurve(const char* label, particle_curve& curve, float maxValue)
+{
+    bool changed = false;
+    ImGui::PushID(label);
+
+    float preview[CURVE_PREVIEW_SAMPLES];
+    for (int i = 0; i < CURVE_PREVIEW_SAMPLES; i++) {
+        preview[i] = curve.Evaluate((float)i / (CURVE_PREVIEW_SAMPLES - 1));
+    }
+    ImGui::PlotLines(label, preview, CURVE_PREVIEW_SAMPLES, 0, nullptr, 0.0f, maxValue, ImVec2(0.0f, 40.0f));
+
+    for (size_t k = 0; k < curve.keys.size(); k++) {
+        ImGui::PushID((int)k);
+        ImGui::PushItemWidth(120.0f);
+        changed |= ImGui::SliderFloat("##age", &curve.keys[k].age, 0.0f, 1.0f, "age %.2f");
+        ImGui::SameLine();
+        changed |= ImGui::SliderFloat("##value", &curve.keys[k].value, 0.0f, maxValue, "%.2f");
+        ImGui::PopItemWidth();
+        ImGui::SameLine();
+        bool remove = curve.keys.size() > 1 && ImGui::Button("Remove");
+        ImGui::PopID();
+        if (remove) {
+            curve.keys.erase(curve.keys.begin() + k);
+            changed = true;
+            break;
+        }
+    }
+    if (ImGui::Button("Add key")) {
+        curve.keys.push_back({ 1.0f, curve.Evaluate(1.0f) });
+        changed = true;
+    }
+    ImGui::PopID();
+    return changed;
+}
+
 int main(int argc, char* argv[])
 {
 	window_props windowProps;
@@ -40,6 +120,9 @@ int main(int argc, char* argv[])
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    Shader::EnableParallelCompile((GLADloadproc)glfwGetProcAddress);
+    // The "Profiler" window drains the zones every frame
+    profiler::Get().Enable();
 
     // Setup Dear ImGui context
     IMGUI_CHECKVERSION();
@@ -59,6 +142,7 @@ int main(int argc, char* argv[])
     
     bool openWindow = true;
     bool pSystemEmit = true;
+    bool gpuSimulation = false;
     bool randomPos = false;
     bool randomSpeed = false;
     bool randomParticleLife = false;
@@ -74,12 +158,64 @@ int main(int argc, char* argv[])
     data.emitQuantity      = 100;
     data.emissionFrequency = 10.0f;
 
-    particle_system particleSystem;
+    job_system jobs;
+
+    // The panel drives the first emitter, the rest are for stress testing.
+    // They copy its settings when they are created and follow its affectors
+    emitter_manager emitters;
+    emitters.jobSystem = &jobs;
+    emitters.Init(MAIN_EMITTER_PARTICLES + MAX_EXTRA_EMITTERS * EXTRA_EMITTER_PARTICLES);
+
+    particle_system& particleSystem = *emitters.CreateEmitter(MAIN_EMITTER_PARTICLES);
     particleSystem.particleData = data;
     particleSystem.looping = true;
+    particleSystem.lifetime = MakeLinearLifetime(data.colorBegin, data.colorEnd);
+    particleSystem.BakeLifetime();
+    int extraEmitters = 0;
+
+    // Affector stack of the main emitter, all off until enabled in the panel
+    {
+        glm::vec2 middle = glm::vec2(window.windowProperties.width, window.windowProperties.height) * 0.5f;
+        particle_affector affector;
+
+        affector.enabled  = false;
+        affector.type     = AFFECTOR_GRAVITY;
+        affector.vector   = glm::vec2(0.0f, 100.0f);
+        particleSystem.affectors.push_back(affector);
+
+        affector.type     = AFFECTOR_DRAG;
+        affector.strength = 0.5f;
+        particleSystem.affectors.push_back(affector);
+
+        affector.type     = AFFECTOR_POINT;
+        affector.center   = middle;
+        affector.strength = 20000.0f;
+        affector.radius   = 0.0f;
+        particleSystem.affectors.push_back(affector);
+
+        affector.type     = AFFECTOR_VORTEX;
+        affector.strength = 20000.0f;
+        affector.radius   = 400.0f;
+        particleSystem.affectors.push_back(affector);
+
+        // Center and vector follow the mouse, see the main loop
+        affector.type     = AFFECTOR_WIND;
+        affector.strength = 8.0f;
+        affector.radius   = 150.0f;
+        particleSystem.affectors.push_back(affector);
+    }
+    glm::vec2 lastMouse = glm::vec2(window.mouseState.xPos, window.mouseState.yPos);
+
+    // Uses particleSystem as its emitter, so the panel below drives both
+    particle_compute_system computeSystem;
+    bool gpuSimulationAvailable = computeSystem.Init(particleSystem);
 
-    particleSystem.Init();
     particleSystem.Emit();
+
+    // The simulation ticks at its own rate and rendering interpolates
+    fixed_timestep simClock(60.0f);
+    float simRate = 60.0f;
+    bool interpolate = true;
     
     glm::vec4 myColor = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
     ImVec2 pos = ImVec2(0.0f, 0.0f);
@@ -91,8 +227,18 @@ int main(int argc, char* argv[])
 
     int particleBurstNr = 1;
 
+    // 0 is the flat color, then the built-in atlas sprites and the burst
+    // flipbook, see particle_atlas.h
+    int sprite = 0;
+
+    // Every emitter is 2D or 3D together, 3D ones are drawn through orbit
+    bool scene3D = false;
+    orbit_camera orbit;
+
 	while (!glfwWindowShouldClose(window.m_Window))
 	{
+        profiler::Get().BeginFrame();
+
         glClearColor(myColor.r, myColor.g, myColor.b, myColor.a);
         glClear(GL_COLOR_BUFFER_BIT);
 
@@ -113,10 +259,20 @@ int main(int argc, char* argv[])
         std::stringstream ss;
         ss << "FPS: " << totalFps << " | " << "Ms / frame: " << floorf(ts.GetMilliseconds() * 100) / 100;
 
+        glm::vec2 mouse = glm::vec2(window.mouseState.xPos, window.mouseState.yPos);
         if (window.mouseState.leftButtonClicked) {
-            particleSystem.particleData.position = glm::vec2(window.mouseState.xPos, window.mouseState.yPos);
+            particleSystem.particleData.position = mouse;
         }
 
+        // The wind blows where the mouse is, as fast as it moves
+        for (particle_affector& affector : particleSystem.affectors) {
+            if (affector.type == AFFECTOR_WIND) {
+                affector.center = mouse;
+                affector.vector = delta > 0.0f ? (mouse - lastMouse) / delta : glm::vec2(0.0f);
+            }
+        }
+        lastMouse = mouse;
+
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
@@ -137,6 +293,95 @@ int main(int argc, char* argv[])
             ImGui::Separator();
             ImGui::TextColored(textColor, "Render info: "); ImGui::SameLine();
             ImGui::Text(ss.str().c_str());
+            ImGui::TextColored(textColor, "Instance upload: "); ImGui::SameLine();
+            ImGui::Text(emitters.renderer.IsPersistentMapped() ? "Persistent ring" : "glBufferSubData");
+            ImGui::TextColored(textColor, "Emitters: "); ImGui::SameLine();
+            ImGui::Text("%d in %d draw call", emitters.GetEmitterCount(), emitters.renderer.drawCommands.empty() ? 0 : 1);
+            ImGui::TextColored(textColor, "Visible instances: "); ImGui::SameLine();
+            ImGui::Text("%d of %d", emitters.visibleParticles, emitters.GetActiveParticles());
+            ImGui::Checkbox("Viewport culling", &emitters.culling);
+            ImGui::TextColored(textColor, "Update kernel: "); ImGui::SameLine();
+            ImGui::Text("%s, %s", GetSimdLevelName(particleSystem.simdLevel), GetUpdateFeatureName(particleSystem.updateFeatures));
+            render_stats renderStats = emitters.renderer.GetStats();
+            ImGui::TextColored(textColor, "GPU upload / draw: "); ImGui::SameLine();
+            if (emitters.renderer.gpuTimer.IsSupported()) {
+                ImGui::Text("%.3f ms / %.3f ms", renderStats.gpuUploadMilliseconds, renderStats.gpuDrawMilliseconds);
+            }
+            else {
+                ImGui::Text("no timer queries");
+            }
+            ImGui::End();
+        }
+
+        // PROFILER WINDOW
+        {
+            profiler& prof = profiler::Get();
+
+            ImGui::Begin("Profiler");
+            ImGui::Checkbox("Pause", &prof.paused); ImGui::SameLine();
+            if (ImGui::Button("Export Chrome trace")) {
+                prof.ExportChromeTrace(PROFILER_TRACE_PATH);
+            }
+
+            const profile_frame* frame = prof.GetLastFrame();
+            if (frame) {
+                double frameNs = (double)(frame->end - frame->start);
+                ImGui::Text("Last frame: %.2f ms | %d zones", frameNs / 1e6, (int)frame->events.size());
+
+                // One lane per thread, nested zones stacked under their parent
+                int threads = prof.GetThreadCount();
+                std::vector<int> laneDepth(threads, 1);
+                for (const profile_event& e : frame->events) {
+                    laneDepth[e.thread] = std::max(laneDepth[e.thread], (int)e.depth + 1);
+                }
+                std::vector<float> laneTop(threads + 1, 0.0f);
+                for (int t = 0; t < threads; t++) {
+                    laneTop[t + 1] = laneTop[t] + laneDepth[t] * PROFILER_LANE_HEIGHT + 4.0f;
+                }
+
+                ImVec2 origin = ImGui::GetCursorScreenPos();
+                float width   = std::max(ImGui::GetContentRegionAvail().x, 100.0f);
+                ImGui::InvisibleButton("timeline", ImVec2(width, laneTop[threads]));
+                bool hovered  = ImGui::IsItemHovered();
+                ImVec2 mouse  = ImGui::GetMousePos();
+
+                ImDrawList* drawList = ImGui::GetWindowDrawList();
+                drawList->PushClipRect(origin, ImVec2(origin.x + width, origin.y + laneTop[threads]), true);
+                for (int t = 0; t < threads; t++) {
+                    ImU32 laneColor = t % 2 ? IM_COL32(40, 40, 40, 255) : IM_COL32(50, 50, 50, 255);
+                    drawList->AddRectFilled(ImVec2(origin.x, origin.y + laneTop[t]), ImVec2(origin.x + width, origin.y + laneTop[t + 1] - 4.0f), laneColor);
+                }
+
+                static const ImU32 zoneColors[] = {
+                    IM_COL32(66, 133, 244, 255), IM_COL32(219, 68, 55, 255), IM_COL32(244, 180, 0, 255),
+                    IM_COL32(15, 157, 88, 255), IM_COL32(171, 71, 188, 255), IM_COL32(0, 172, 193, 255),
+                };
+                const profile_event* hoveredZone = nullptr;
+                for (const profile_event& e : frame->events) {
+                    // Zones still open when the frame started are cut at its edges
+                    double start = e.start > frame->start ? (double)(e.start - frame->start) : 0.0;
+                    double end   = e.end > frame->start ? (double)(e.end - frame->start) : 0.0;
+                    float x0 = origin.x + (float)(start / frameNs) * width;
+                    float x1 = origin.x + std::max((float)(end / frameNs) * width, (float)(start / frameNs) * width + 1.0f);
+                    float y0 = origin.y + laneTop[e.thread] + e.depth * PROFILER_LANE_HEIGHT;
+                    float y1 = y0 + PROFILER_LANE_HEIGHT - 1.0f;
+
+                    // Same zone, same color, frame after frame
+                    size_t hash = std::hash<const void*>()(e.name);
+                    drawList->AddRectFilled(ImVec2(x0, y0), ImVec2(x1, y1), zoneColors[hash % 6]);
+                    if (x1 - x0 > ImGui::CalcTextSize(e.name).x + 4.0f) {
+                        drawList->AddText(ImVec2(x0 + 2.0f, y0 + 1.0f), IM_COL32(255, 255, 255, 255), e.name);
+                    }
+                    if (hovered && mouse.x >= x0 && mouse.x < x1 && mouse.y >= y0 && mouse.y < y1) {
+                        hoveredZone = &e;
+                    }
+                }
+                drawList->PopClipRect();
+
+                if (hoveredZone) {
+                    ImGui::SetTooltip("%s\nThread %u\n%.3f ms", hoveredZone->name, hoveredZone->thread, (hoveredZone->end - hoveredZone->start) / 1e6);
+                }
+            }
             ImGui::End();
         }
 
@@ -159,6 +404,14 @@ int main(int argc, char* argv[])
             ImGui::SameLine();
             if (ImGui::Button("Clear")) {
                 particleSystem.ClearParticles();
+                if (gpuSimulationAvailable) {
+                    computeSystem.ClearParticles();
+                }
+            }
+            // The GPU simulation is 2D only
+            if (gpuSimulationAvailable && !scene3D) {
+                ImGui::SameLine();
+                ImGui::Checkbox("GPU simulation", &gpuSimulation);
             }
 
             ImGui::Separator();
@@ -241,24 +494,208 @@ int main(int argc, char* argv[])
 
             ImGui::Separator();
 
+            // Interaction, CPU simulation only
+            {
+                ImGui::TextColored(ImVec4(0.0f, 0.0f, 1.0f, 1.0f), "Collisions");
+                ImGui::Checkbox("Enabled", &particleSystem.collision.enabled);
+                ImGui::DragFloat("Radius", &particleSystem.collision.radius, 0.05f, 0.5f, 50.0f);
+                ImGui::SliderFloat("Restitution", &particleSystem.collision.restitution, 0.0f, 1.0f);
+            }
+
+            ImGui::Separator();
+
+            // Affectors, applied in this order before integration
+            {
+                ImGui::TextColored(ImVec4(0.0f, 0.0f, 1.0f, 1.0f), "Affectors");
+                for (size_t a = 0; a < particleSystem.affectors.size(); a++) {
+                    particle_affector& affector = particleSystem.affectors[a];
+                    ImGui::PushID((int)a);
+                    ImGui::Checkbox(GetAffectorName(affector.type), &affector.enabled);
+                    switch (affector.type) {
+                        case AFFECTOR_GRAVITY:
+                            ImGui::DragFloat2("Acceleration", (float*)&affector.vector, 1.0f);
+                            break;
+                        case AFFECTOR_DRAG:
+                            ImGui::DragFloat("Drag", &affector.strength, 0.01f, 0.0f, 20.0f);
+                            break;
+                        case AFFECTOR_POINT:
+                        case AFFECTOR_VORTEX:
+                            ImGui::DragFloat2("Center", (float*)&affector.center, 1.0f);
+                            ImGui::DragFloat("Strength", &affector.strength, 100.0f);
+                            ImGui::DragFloat("Range", &affector.radius, 1.0f, 0.0f, 5000.0f);
+                            break;
+                        case AFFECTOR_WIND:
+                            ImGui::DragFloat("Strength", &affector.strength, 0.1f, 0.0f, 60.0f);
+                            ImGui::DragFloat("Range", &affector.radius, 1.0f, 0.0f, 5000.0f);
+                            break;
+                        default:
+                            break;
+                    }
+                    ImGui::PopID();
+                }
+            }
+
+            ImGui::Separator();
+
+            // 3D. Particles don't carry over between spaces, so switching
+            // clears every emitter
+            {
+                ImGui::TextColored(ImVec4(0.0f, 0.0f, 1.0f, 1.0f), "3D");
+                if (ImGui::Checkbox("3D particles", &scene3D)) {
+                    for (managed_emitter& emitter : emitters.emitters) {
+                        emitter.system->space = scene3D ? SPACE_3D : SPACE_2D;
+                        emitter.system->ClearParticles();
+                    }
+                    orbit.target = glm::vec3(window.windowProperties.width * 0.5f, window.windowProperties.height * 0.5f, 0.0f);
+                    emitters.renderer.camera.orbit = scene3D ? &orbit : nullptr;
+                    gpuSimulation = false;
+                }
+                if (scene3D) {
+                    ImGui::SliderFloat("Yaw", &orbit.yaw, -3.14159f, 3.14159f);
+                    ImGui::SliderFloat("Pitch", &orbit.pitch, -1.5f, 1.5f);
+                    ImGui::SliderFloat("Zoom", &orbit.zoom, 0.1f, 10.0f);
+                    ImGui::DragFloat("Start z", &particleSystem.particleData.positionZ, 1.0f);
+                    ImGui::DragFloat("Speed z", &particleSystem.particleData.speedZ, 0.1f);
+                }
+            }
+
+            ImGui::Separator();
+
+            // Sprites from the renderer's atlas, all emitters still share
+            // the one draw
+            {
+                ImGui::TextColored(ImVec4(0.0f, 0.0f, 1.0f, 1.0f), "Sprite");
+                particle_flipbook& flipbook = particleSystem.flipbook;
+                if (ImGui::Combo("Shape", &sprite, "Flat\0Soft\0Star\0Ring\0Spark\0Burst flipbook\0")) {
+                    if (sprite == 0) {
+                        flipbook.frameCount = 0;
+                    }
+                    else if (sprite <= SPRITE_SPARK + 1) {
+                        flipbook.firstFrame = sprite - 1;
+                        flipbook.frameCount = 1;
+                    }
+                    else {
+                        flipbook.firstFrame = SPRITE_BURST_FIRST;
+                        flipbook.frameCount = SPRITE_BURST_FRAMES;
+                    }
+                }
+                if (flipbook.frameCount > 1) {
+                    ImGui::SliderFloat("Cycles per life", &flipbook.cycles, 0.25f, 8.0f);
+                }
+            }
+
+            ImGui::Separator();
+
+            // Draw order. Blending applies to every emitter in the draw,
+            // sorting and layers to each emitter
+            {
+                ImGui::TextColored(ImVec4(0.0f, 0.0f, 1.0f, 1.0f), "Draw order");
+                bool alphaBlend = emitters.renderer.blendMode == BLEND_ALPHA;
+                if (ImGui::Checkbox("Alpha blending", &alphaBlend)) {
+                    emitters.renderer.blendMode = alphaBlend ? BLEND_ALPHA : BLEND_ADDITIVE;
+                }
+                ImGui::Combo("Sort by", (int*)&particleSystem.drawSort.key, "None\0Age\0Depth\0");
+                ImGui::DragInt("Layer", &particleSystem.drawSort.layer, 0.1f, -16, 16);
+                if (particleSystem.drawSort.key != SORT_NONE) {
+                    const draw_sort_stats& sortStats = particleSystem.sortStats;
+                    ImGui::Text("%s, %lld moves", sortStats.radix ? "Radix sort" : sortStats.reordered ? "Insertion sort" : "Already sorted", sortStats.moves);
+                }
+            }
+
+            ImGui::Separator();
+
+            // Throttles every emitter to hold the particles' share of the
+            // frame, CPU simulation only
+            {
+                ImGui::TextColored(ImVec4(0.0f, 0.0f, 1.0f, 1.0f), "Frame budget");
+                governor_settings& governor = emitters.governor.settings;
+                ImGui::Checkbox("Governor", &governor.enabled);
+                ImGui::SliderFloat("Target (ms)", &governor.targetMilliseconds, 0.5f, 16.0f, "%.1f");
+                ImGui::SliderFloat("Min scale", &governor.minScale, 0.0f, 1.0f, "%.2f");
+                ImGui::Checkbox("Decimate over cap", &governor.decimate);
+                ImGui::DragInt("Priority", &particleSystem.budget.priority, 0.1f, -16, 16);
+                if (governor.enabled) {
+                    const governor_stats& stats = emitters.governor.stats;
+                    ImGui::Text("%.2f ms | pressure %.2f | %d throttled", stats.frameMilliseconds, stats.pressure, stats.throttledEmitters);
+                    ImGui::Text("Frame: %d shed, %d refused, %d decimated", stats.frame.shed, stats.frame.refused, stats.frame.decimated);
+                    ImGui::Text("Total: %lld shed, %lld refused, %lld decimated", stats.totalShed, stats.totalRefused, stats.totalDecimated);
+                }
+            }
+
+            ImGui::Separator();
+
             // System control
             {
                 ImGui::TextColored(ImVec4(0.0f, 0.0f, 1.0f, 1.0f), "System control");
                 ImGui::DragInt("", &particleBurstNr, 0.2f, 0.0f, 1000.0f, "%.d");
                 ImGui::SameLine();
                 if (ImGui::Button("Particle burst")) {
-                    particleSystem.ParticleBurst(particleBurstNr);
+                    if (gpuSimulation) {
+                        computeSystem.ParticleBurst(particleBurstNr);
+                    }
+                    else {
+                        particleSystem.ParticleBurst(particleBurstNr);
+                    }
                 }
                 ImGui::DragInt("Nr. particles", (int*)&particleSystem.particleData.emitQuantity, 0.2f, 0.0f, particleSystem.totalParticles, "%.d");
                 ImGui::DragFloat("Timeframe", (float*)&particleSystem.particleData.emissionFrequency, 0.2f, 0.0f, 100.0f, "%.2f", 1.0f);
                 ImGui::InputFloat2("Position", (float*)&particleSystem.particleData.position);
                 ImGui::InputFloat2("Speed", (float*)&particleSystem.particleData.speed);
-                ImGui::InputFloat2("Start scale", (float*)&particleSystem.particleData.scaleBegin);
-                ImGui::InputFloat2("End scale", (float*)&particleSystem.particleData.scaleEnd);
-                ImGui::ColorEdit4("Start color", (float*)&particleSystem.particleData.colorBegin);
-                ImGui::ColorEdit4("End color", (float*)&particleSystem.particleData.colorEnd);
+                bool rebake = false;
+                rebake |= ImGui::InputFloat2("Start scale", (float*)&particleSystem.particleData.scaleBegin);
+                rebake |= ImGui::InputFloat2("End scale", (float*)&particleSystem.particleData.scaleEnd);
+                // The curves replace the start/end lerp, CPU simulation only
+                rebake |= ImGui::Checkbox("Lifetime curves", &particleSystem.lifetime.enabled);
+                if (particleSystem.lifetime.enabled && !gpuSimulation) {
+                    rebake |= EditGradient("Color", particleSystem.lifetime.color);
+                    rebake |= EditCurve("Alpha", particleSystem.lifetime.alpha, 1.0f);
+                    rebake |= EditCurve("Scale (start to end)", particleSystem.lifetime.scale, 2.0f);
+                }
+                else {
+                    bool recolor = false;
+                    recolor |= ImGui::ColorEdit4("Start color", (float*)&particleSystem.particleData.colorBegin);
+                    recolor |= ImGui::ColorEdit4("End color", (float*)&particleSystem.particleData.colorEnd);
+                    // The gradient starts over from the new colors, so it
+                    // matches them whenever the curves are turned on
+                    if (recolor) {
+                        particle_data& current = particleSystem.particleData;
+                        particleSystem.lifetime.color = MakeLinearLifetime(current.colorBegin, current.colorEnd).color;
+                        rebake = true;
+                    }
+                }
+                if (rebake) {
+                    particleSystem.BakeLifetime();
+                }
                 ImGui::DragFloat("Particle life", (float*)&particleSystem.particleData.totalLife, 0.2f, 0.0f, 100.0f, "%.2f", 1.0f);
 
+                ImGui::Separator();
+                if (ImGui::DragFloat("Simulation rate (Hz)", &simRate, 0.5f, 10.0f, 240.0f, "%.1f", 1.0f)) {
+                    simClock.SetTickRate(simRate);
+                }
+                ImGui::DragInt("Max substeps", &simClock.maxSubsteps, 0.1f, 1, 32);
+                ImGui::Checkbox("Interpolate", &interpolate);
+                if (ImGui::DragInt("Extra emitters", &extraEmitters, 0.2f, 0, MAX_EXTRA_EMITTERS)) {
+                    while (emitters.GetEmitterCount() - 1 < extraEmitters) {
+                        particle_system* extra = emitters.CreateEmitter(EXTRA_EMITTER_PARTICLES);
+                        extra->particleData = particleSystem.particleData;
+                        extra->affectors    = particleSystem.affectors;
+                        extra->lifetime     = particleSystem.lifetime;
+                        extra->drawSort     = particleSystem.drawSort;
+                        extra->space        = particleSystem.space;
+                        extra->flipbook     = particleSystem.flipbook;
+                        extra->budget.priority = particleSystem.budget.priority;
+                        extra->BakeLifetime();
+                        extra->particleData.position = glm::vec2(
+                            extra->random.Uniform(RANDOM_POSITION_X, 0, 0.0f, (float)window.windowProperties.width),
+                            extra->random.Uniform(RANDOM_POSITION_Y, 0, 0.0f, (float)window.windowProperties.height));
+                        extra->Emit();
+                    }
+                    while (emitters.GetEmitterCount() - 1 > extraEmitters) {
+                        emitters.DestroyEmitter(emitters.emitters.back().system.get());
+                    }
+                }
+                ImGui::Text("Substeps: %d | Dropped ticks: %lld", simClock.lastSubsteps, simClock.droppedTicks);
+
                 ImGui::Separator();
                 ImGui::ColorEdit4("BACKGROUND COLOR", (float*)&myColor);
 
@@ -273,10 +710,47 @@ int main(int argc, char* argv[])
 
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
         
-        particleSystem.Update(ts);
+        int ticks = simClock.Advance(ts);
+        float alpha = interpolate ? simClock.GetAlpha() : 1.0f;
+
+        if (gpuSimulation) {
+            for (int tick = 0; tick < ticks; tick++) {
+                computeSystem.Update(simClock.GetTick());
+            }
+            computeSystem.Render((1.0f - alpha) * simClock.tickSeconds);
+        }
+        else {
+            // The wind and the panel only touch the first emitter's stack
+            for (managed_emitter& emitter : emitters.emitters) {
+                if (emitter.system.get() != &particleSystem) {
+                    emitter.system->affectors = particleSystem.affectors;
+                }
+            }
+            for (int tick = 0; tick < ticks; tick++) {
+                emitters.Update(simClock.GetTick());
+            }
+            // Matches the camera's glm::ortho(0, width, height, 0)
+            emitters.view.min = glm::vec2(0.0f);
+            emitters.view.max = glm::vec2(window.windowProperties.width, window.windowProperties.height);
+            if (scene3D) {
+                float width  = (float)window.windowProperties.width;
+                float height = (float)window.windowProperties.height;
+                camera_uniforms camera = orbit.GetUniforms(width, height);
+                SetFrustum(emitters.view, camera.projection * camera.view);
+                for (managed_emitter& emitter : emitters.emitters) {
+                    emitter.system->drawSort.viewPosition = orbit.GetPosition(height);
+                    emitter.system->drawSort.viewForward  = orbit.GetForward();
+                }
+            }
+            emitters.UploadToGPU(alpha);
+            emitters.Render();
+        }
 
 		glfwPollEvents();
-		glfwSwapBuffers(window.m_Window);
+		{
+			PROFILE_SCOPE("Swap buffers");
+			glfwSwapBuffers(window.m_Window);
+		}
 	}
 
     ImGui_ImplOpenGL3_Shutdown();
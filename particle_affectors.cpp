@@ -0,0 +1,151 @@
+#include "particle_affectors.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define PARTICLES_X86 1
+#else
+    #define PARTICLES_X86 0
+#endif
+
+// Same rounding on every level, see particle_kernels.cpp. The loops below
+// are left to the auto-vectorizer, which -O2 only enables in its cheapest
+// form on GCC
+#if defined(__clang__)
+    #pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+    #pragma GCC optimize("fp-contract=off", "tree-vectorize")
+#endif
+
+#if PARTICLES_X86 && !defined(_MSC_VER)
+    #define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+    #define SIMD_TARGET(isa)
+#endif
+
+// Forced on every target, the ISA wrappers rely on the bodies being inlined
+#if defined(_MSC_VER)
+    #define AFFECTOR_INLINE __forceinline
+#else
+    #define AFFECTOR_INLINE inline __attribute__((always_inline))
+#endif
+
+// The bodies are written once and inlined into a wrapper per ISA, which is
+// where they get vectorized. Clamps are written as selects so the loops
+// have no branches.
+
+static AFFECTOR_INLINE void Gravity(const particle_columns& c, int begin, int end, const particle_affector& a, float delta)
+{
+    glm::vec2 dv = a.vector * delta;
+    float* speed = (float*)c.speed;
+    for (int i = begin; i < end; i++) {
+        speed[2 * i]     += dv.x;
+        speed[2 * i + 1] += dv.y;
+    }
+}
+
+static AFFECTOR_INLINE void Drag(const particle_columns& c, int begin, int end, const particle_affector& a, float delta)
+{
+    // Clamped so a large step stops the particle instead of reversing it
+    float keep = 1.0f - a.strength * delta;
+    keep = keep > 0.0f ? keep : 0.0f;
+    float* speed = (float*)c.speed;
+    for (int i = 2 * begin; i < 2 * end; i++) {
+        speed[i] *= keep;
+    }
+}
+
+// Squared distance over which the radial falloff goes from 1 to 0. The
+// math stays on squared distances: sqrtf may set errno, which keeps GCC
+// from vectorizing it without -fno-math-errno
+static AFFECTOR_INLINE float Falloff(float distance2, float inverseRadius2)
+{
+    float f = 1.0f - distance2 * inverseRadius2;
+    return f > 0.0f ? f : 0.0f;
+}
+
+// Point and vortex pull with strength / distance, like gravity in the
+// plane, and differ only in the direction it is applied
+template <bool Tangential>
+static AFFECTOR_INLINE void Radial(const particle_columns& c, int begin, int end, const particle_affector& a, float delta)
+{
+    float inverseRadius2 = a.radius > 0.0f ? 1.0f / (a.radius * a.radius) : 0.0f;
+    float softening2 = AFFECTOR_SOFTENING * AFFECTOR_SOFTENING;
+    float step = a.strength * delta;
+    const float* position = (const float*)c.position;
+    float* speed = (float*)c.speed;
+    for (int i = begin; i < end; i++) {
+        float dx = a.center.x - position[2 * i];
+        float dy = a.center.y - position[2 * i + 1];
+        float distance2 = dx * dx + dy * dy;
+        // d / (|d|^2 + s^2) is the unit direction over the distance
+        float scale = step * Falloff(distance2, inverseRadius2) / (distance2 + softening2);
+        if (Tangential) {
+            speed[2 * i]     -= dy * scale;
+            speed[2 * i + 1] += dx * scale;
+        }
+        else {
+            speed[2 * i]     += dx * scale;
+            speed[2 * i + 1] += dy * scale;
+        }
+    }
+}
+
+static AFFECTOR_INLINE void Wind(const particle_columns& c, int begin, int end, const particle_affector& a, float delta)
+{
+    float inverseRadius2 = a.radius > 0.0f ? 1.0f / (a.radius * a.radius) : 0.0f;
+    float step = a.strength * delta;
+    const float* position = (const float*)c.position;
+    float* speed = (float*)c.speed;
+    for (int i = begin; i < end; i++) {
+        float dx = position[2 * i] - a.center.x;
+        float dy = position[2 * i + 1] - a.center.y;
+        float blend = step * Falloff(dx * dx + dy * dy, inverseRadius2);
+        blend = blend < 1.0f ? blend : 1.0f;
+        speed[2 * i]     += (a.vector.x - speed[2 * i]) * blend;
+        speed[2 * i + 1] += (a.vector.y - speed[2 * i + 1]) * blend;
+    }
+}
+
+#define AFFECTOR_WRAPPERS(suffix, isa) \
+    SIMD_TARGET(isa) static void Gravity##suffix(const particle_columns& c, int b, int e, const particle_affector& a, float d) { Gravity(c, b, e, a, d); } \
+    SIMD_TARGET(isa) static void Drag##suffix(const particle_columns& c, int b, int e, const particle_affector& a, float d) { Drag(c, b, e, a, d); } \
+    SIMD_TARGET(isa) static void Point##suffix(const particle_columns& c, int b, int e, const particle_affector& a, float d) { Radial<false>(c, b, e, a, d); } \
+    SIMD_TARGET(isa) static void Vortex##suffix(const particle_columns& c, int b, int e, const particle_affector& a, float d) { Radial<true>(c, b, e, a, d); } \
+    SIMD_TARGET(isa) static void Wind##suffix(const particle_columns& c, int b, int e, const particle_affector& a, float d) { Wind(c, b, e, a, d); }
+
+#define AFFECTOR_KERNEL_SET(suffix) { Gravity##suffix, Drag##suffix, Point##suffix, Vortex##suffix, Wind##suffix }
+
+AFFECTOR_WRAPPERS(Scalar, "default")
+#if PARTICLES_X86
+AFFECTOR_WRAPPERS(SSE42, "sse4.2")
+AFFECTOR_WRAPPERS(AVX2, "avx2")
+AFFECTOR_WRAPPERS(AVX512, "avx512f")
+#endif
+
+static const particle_affector_kernel s_AffectorKernels[][AFFECTOR_TYPE_COUNT] = {
+    AFFECTOR_KERNEL_SET(Scalar),
+#if PARTICLES_X86
+    AFFECTOR_KERNEL_SET(SSE42),
+    AFFECTOR_KERNEL_SET(AVX2),
+    AFFECTOR_KERNEL_SET(AVX512),
+#endif
+};
+
+particle_affector_kernel GetAffectorKernel(simd_level level, affector_type type)
+{
+    if (level > DetectSimdLevel()) {
+        level = DetectSimdLevel();
+    }
+    return s_AffectorKernels[level][type];
+}
+
+const char* GetAffectorName(affector_type type)
+{
+    switch (type) {
+        case AFFECTOR_GRAVITY: return "Gravity";
+        case AFFECTOR_DRAG:    return "Drag";
+        case AFFECTOR_POINT:   return "Attractor";
+        case AFFECTOR_VORTEX:  return "Vortex";
+        case AFFECTOR_WIND:    return "Wind";
+        default:               return "Unknown";
+    }
+}
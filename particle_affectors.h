@@ -0,0 +1,40 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include "particle_kernels.h"
+
+// Distance under which the point and vortex pull stops growing, so a
+// particle crossing the center isn't flung away
+#define AFFECTOR_SOFTENING 8.0f
+
+enum affector_type
+{
+	AFFECTOR_GRAVITY = 0, // speed += vector * delta
+	AFFECTOR_DRAG,        // speed -= speed * strength * delta
+	AFFECTOR_POINT,       // pull of strength / distance toward center, negative repels
+	AFFECTOR_VORTEX,      // swirl of strength / distance around center, counterclockwise
+	AFFECTOR_WIND,        // speed eases toward vector around center
+	AFFECTOR_TYPE_COUNT
+};
+
+// One force in an emitter's stack, vector, center and strength mean what the
+// type says above. Point, vortex and wind fade out toward radius, and a
+// radius of 0 reaches everywhere.
+struct particle_affector
+{
+	affector_type type = AFFECTOR_GRAVITY;
+	bool enabled   = true;
+	glm::vec2 vector = glm::vec2(0.0f);
+	glm::vec2 center = glm::vec2(0.0f);
+	float strength = 0.0f;
+	float radius   = 0.0f;
+};
+
+// Applies one affector to the speeds of particles [begin, end). Each type is
+// a plain loop over the columns, compiled once per simd_level, so a stack
+// of affectors costs a streaming pass each and no per-particle dispatch.
+// Like the update kernels, every level gives bit-identical results.
+typedef void (*particle_affector_kernel)(const particle_columns& columns, int begin, int end, const particle_affector& affector, float delta);
+
+particle_affector_kernel GetAffectorKernel(simd_level level, affector_type type);
+const char* GetAffectorName(affector_type type);
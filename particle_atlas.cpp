@@ -0,0 +1,57 @@
+#include "particle_atlas.h"
+
+#include <cmath>
+
+static float Saturate(float v)
+{
+    return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+}
+
+// Alpha of a cell at (x, y) in [-1, 1], the cell's center at 0
+static float SpriteAlpha(int cell, float x, float y)
+{
+    float r = sqrtf(x * x + y * y);
+    switch (cell) {
+        case SPRITE_SOFT:
+            return Saturate(1.0f - r) * Saturate(1.0f - r);
+        case SPRITE_STAR: {
+            // Thin bright arms along the axes over a small core
+            float arms = Saturate(1.0f - fabsf(x) * 8.0f) + Saturate(1.0f - fabsf(y) * 8.0f);
+            return Saturate(arms * Saturate(1.0f - r) + Saturate(1.0f - r * 3.0f));
+        }
+        case SPRITE_RING:
+            return Saturate(1.0f - fabsf(r - 0.7f) * 8.0f);
+        case SPRITE_SPARK:
+            // Streak along x
+            return Saturate(1.0f - fabsf(y) * 6.0f) * Saturate(1.0f - fabsf(x));
+        default:
+            break;
+    }
+
+    int frame = cell - SPRITE_BURST_FIRST;
+    if (frame >= 0 && frame < SPRITE_BURST_FRAMES) {
+        float t = (float)frame / (float)(SPRITE_BURST_FRAMES - 1);
+        float radius = 0.1f + 0.8f * t;
+        float width  = 0.25f - 0.15f * t;
+        return Saturate(1.0f - fabsf(r - radius) / width) * (1.0f - t * 0.8f);
+    }
+    return 0.0f;
+}
+
+void BuildDefaultAtlas(std::vector<uint32_t>& pixels, int& width, int& height)
+{
+    width  = DEFAULT_ATLAS_COLUMNS * DEFAULT_ATLAS_CELL_SIZE;
+    height = DEFAULT_ATLAS_ROWS * DEFAULT_ATLAS_CELL_SIZE;
+    pixels.assign((size_t)width * height, 0);
+
+    for (int py = 0; py < height; py++) {
+        for (int px = 0; px < width; px++) {
+            int cell = (py / DEFAULT_ATLAS_CELL_SIZE) * DEFAULT_ATLAS_COLUMNS + px / DEFAULT_ATLAS_CELL_SIZE;
+            // Pixel centers, so the sprites are symmetric
+            float x = ((px % DEFAULT_ATLAS_CELL_SIZE) + 0.5f) / DEFAULT_ATLAS_CELL_SIZE * 2.0f - 1.0f;
+            float y = ((py % DEFAULT_ATLAS_CELL_SIZE) + 0.5f) / DEFAULT_ATLAS_CELL_SIZE * 2.0f - 1.0f;
+            uint32_t alpha = (uint32_t)(SpriteAlpha(cell, x, y) * 255.0f + 0.5f);
+            pixels[(size_t)py * width + px] = 0x00FFFFFFu | (alpha << 24);
+        }
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Instance frame of particles drawn with their flat color, no sprite
+#define PARTICLE_NO_SPRITE 0xFFFFFFFFu
+
+// Layout of the built-in atlas, see BuildDefaultAtlas
+#define DEFAULT_ATLAS_CELL_SIZE 32
+#define DEFAULT_ATLAS_COLUMNS 8
+#define DEFAULT_ATLAS_ROWS 4
+
+// Cells of the built-in atlas
+enum default_sprite
+{
+	SPRITE_SOFT = 0,
+	SPRITE_STAR,
+	SPRITE_RING,
+	SPRITE_SPARK,
+	// Flipbook of a ring expanding and fading out
+	SPRITE_BURST_FIRST = DEFAULT_ATLAS_COLUMNS,
+	SPRITE_BURST_FRAMES = 2 * DEFAULT_ATLAS_COLUMNS
+};
+
+// Which atlas cells an emitter's particles show. Cells are numbered row by
+// row from the top left. A particle steps through frameCount cells starting
+// at firstFrame over its life, cycles times. frameCount 0 draws the flat
+// particle color
+struct particle_flipbook
+{
+	int firstFrame = 0;
+	int frameCount = 0;
+	float cycles = 1.0f;
+};
+
+// Atlas cell for a normalized age
+inline uint32_t FlipbookFrame(const particle_flipbook& flipbook, float age)
+{
+	if (flipbook.frameCount <= 0) {
+		return PARTICLE_NO_SPRITE;
+	}
+	// Just below 1, so the last moment of a life still shows the last frame
+	const float lastAge = 0.99999994f;
+	age = age > 0.0f ? age : 0.0f;
+	age = age < lastAge ? age : lastAge;
+	int step = (int)(age * flipbook.cycles * (float)flipbook.frameCount);
+	return (uint32_t)(flipbook.firstFrame + step % flipbook.frameCount);
+}
+
+// RGBA8 sprites generated in code, white with the shape in alpha so the
+// particle color tints them. DEFAULT_ATLAS_COLUMNS x DEFAULT_ATLAS_ROWS
+// cells of DEFAULT_ATLAS_CELL_SIZE pixels, top row first
+void BuildDefaultAtlas(std::vector<uint32_t>& pixels, int& width, int& height);
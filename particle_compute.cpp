@@ -0,0 +1,220 @@
+#include "particle_compute.h"
+
+#include "particle_system.h"
+#include "window.h"
+#include "profiler.h"
+#include <glm/gtc/type_ptr.hpp>
+
+#define WORKGROUP_SIZE 64
+// Byte offset of the DispatchIndirectCommand in COMMAND_BUFFER, right
+// after the 20 byte DrawElementsIndirectCommand
+#define DISPATCH_COMMAND_OFFSET 20
+#define COMMAND_BUFFER_SIZE     32
+
+#define STATE_SRC_BINDING 0
+#define STATE_DST_BINDING 1
+#define COUNTER_BINDING   2
+#define SPAWN_BINDING     3
+#define COMMAND_BINDING   4
+
+bool particle_compute_system::Init(particle_system& particleEmitter)
+{
+    if (!GLAD_GL_VERSION_4_3) {
+        std::cout << "GPU particle simulation needs OpenGL 4.3" << std::endl;
+        return false;
+    }
+
+    emitter        = &particleEmitter;
+    totalParticles = particleEmitter.totalParticles;
+    srcSlot        = 0;
+
+    float pVerts[] = {
+        0.5f,  0.5f,
+        0.5f, -0.5f,
+       -0.5f, -0.5f,
+       -0.5f,  0.5f,
+    };
+
+    unsigned int pIndices[] = {
+        0, 1, 3,
+        1, 2, 3
+    };
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(pIndices), pIndices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(pVerts), pVerts, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void*)0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    glGenBuffers(2, STATE_SSBO);
+    glGenBuffers(1, &COUNTER_SSBO);
+    glGenBuffers(1, &SPAWN_SSBO);
+    glGenBuffers(1, &COMMAND_BUFFER);
+
+    for (int slot = 0; slot < 2; slot++) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, STATE_SSBO[slot]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, totalParticles * sizeof(gpu_particle), nullptr, GL_DYNAMIC_COPY);
+    }
+
+    GLuint zeroCounters[2] = { 0, 0 };
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, COUNTER_SSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(zeroCounters), zeroCounters, GL_DYNAMIC_COPY);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, COMMAND_BUFFER);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, COMMAND_BUFFER_SIZE, nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    updateShader   = std::make_unique<Shader>("Shaders/particle_update.comp");
+    spawnShader    = std::make_unique<Shader>("Shaders/particle_spawn.comp");
+    finalizeShader = std::make_unique<Shader>("Shaders/particle_finalize.comp");
+    renderShader   = std::make_unique<Shader>("Shaders/particle_compute_vertex.glsl", "Shaders/fragment.glsl");
+    renderShader->BindUniformBlock("Camera", CAMERA_UBO_BINDING);
+    camera.Init();
+
+    Finalize(srcSlot);
+
+    std::cout << "GPU particle simulation initialized" << std::endl;
+    return true;
+}
+
+void particle_compute_system::Update(timestep ts)
+{
+    PROFILE_SCOPE("GPU particle update");
+    int dstSlot = 1 - srcSlot;
+
+    // Integrate survivors of srcSlot and append them to dstSlot
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STATE_SRC_BINDING, STATE_SSBO[srcSlot]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STATE_DST_BINDING, STATE_SSBO[dstSlot]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COUNTER_BINDING, COUNTER_SSBO);
+
+    updateShader->Bind();
+    glUniform1ui(updateShader->GetUniformLocation("srcSlot"), srcSlot);
+    glUniform1f(updateShader->GetUniformLocation("delta"), ts.GetSeconds());
+
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, COMMAND_BUFFER);
+    glDispatchComputeIndirect(DISPATCH_COMMAND_OFFSET);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // Timed particle emission, appended after the survivors
+    if (emitter->emitting && emitter->looping) {
+        float oldestAge, ageStep;
+        int owed = emitter->AccrueEmission(ts, oldestAge, ageStep);
+        if (owed > 0) {
+            Spawn(dstSlot, owed < totalParticles ? owed : totalParticles, oldestAge, ageStep);
+        }
+    }
+
+    Finalize(dstSlot);
+    srcSlot = dstSlot;
+}
+
+void particle_compute_system::Spawn(int slot, int count, float oldestAge, float ageStep)
+{
+    emitter->DrawSpawnAttributes(count);
+
+    spawnStaging.resize(count);
+    for (int j = 0; j < count; j++) {
+        spawnStaging[j].origin = emitter->spawnOrigin[j];
+        spawnStaging[j].speed  = emitter->spawnSpeed[j];
+        spawnStaging[j].life   = emitter->spawnLife[j];
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, SPAWN_SSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(gpu_spawn_attributes), spawnStaging.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STATE_DST_BINDING, STATE_SSBO[slot]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COUNTER_BINDING, COUNTER_SSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SPAWN_BINDING, SPAWN_SSBO);
+
+    const particle_data& data = emitter->particleData;
+
+    spawnShader->Bind();
+    glUniform1ui(spawnShader->GetUniformLocation("dstSlot"), slot);
+    glUniform1ui(spawnShader->GetUniformLocation("spawnCount"), count);
+    glUniform1ui(spawnShader->GetUniformLocation("capacity"), totalParticles);
+    glUniform1f(spawnShader->GetUniformLocation("oldestAge"), oldestAge);
+    glUniform1f(spawnShader->GetUniformLocation("ageStep"), ageStep);
+    glUniform4fv(spawnShader->GetUniformLocation("colorBegin"), 1, glm::value_ptr(data.colorBegin));
+    glUniform4fv(spawnShader->GetUniformLocation("colorEnd"), 1, glm::value_ptr(data.colorEnd));
+    glUniform2fv(spawnShader->GetUniformLocation("scaleBegin"), 1, glm::value_ptr(data.scaleBegin));
+    glUniform2fv(spawnShader->GetUniformLocation("scaleEnd"), 1, glm::value_ptr(data.scaleEnd));
+
+    glDispatchCompute((count + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void particle_compute_system::Finalize(int slot)
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COUNTER_BINDING, COUNTER_SSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMAND_BINDING, COMMAND_BUFFER);
+
+    finalizeShader->Bind();
+    glUniform1ui(finalizeShader->GetUniformLocation("slot"), slot);
+    glUniform1ui(finalizeShader->GetUniformLocation("capacity"), totalParticles);
+
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+}
+
+void particle_compute_system::ParticleBurst(unsigned int nrParticles)
+{
+    int count = (int)nrParticles < totalParticles ? (int)nrParticles : totalParticles;
+    if (count <= 0) {
+        return;
+    }
+
+    Spawn(srcSlot, count, 0.0f, 0.0f);
+    Finalize(srcSlot);
+}
+
+void particle_compute_system::ClearParticles()
+{
+    GLuint zeroCounters[2] = { 0, 0 };
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, COUNTER_SSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zeroCounters), zeroCounters);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    Finalize(srcSlot);
+}
+
+void particle_compute_system::Render(float rewindSeconds)
+{
+    PROFILE_SCOPE("GPU particle draw");
+    renderShader->Bind();
+    camera.Bind(window::s_Instance->windowProperties.width, window::s_Instance->windowProperties.height);
+
+    glUniform1f(renderShader->GetUniformLocation("rewind"), rewindSeconds);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STATE_SRC_BINDING, STATE_SSBO[srcSlot]);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, COMMAND_BUFFER);
+
+    glBindVertexArray(VAO);
+    glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0);
+    glBindVertexArray(0);
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void particle_compute_system::ReadBackParticles(std::vector<gpu_particle>& out)
+{
+    GLuint counters[2];
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, COUNTER_SSBO);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counters), counters);
+
+    out.resize(counters[srcSlot]);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, STATE_SSBO[srcSlot]);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, out.size() * sizeof(gpu_particle), out.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include "timestep.h"
+#include "Shader.h"
+#include "camera.h"
+
+struct particle_system;
+
+// Mirrors the std430 particle struct in Shaders/particle_*.comp
+struct gpu_particle
+{
+	glm::vec2 position;
+	glm::vec2 speed;
+	glm::vec4 colorBegin;
+	glm::vec4 colorEnd;
+	glm::vec4 color;
+	glm::vec2 scaleBegin;
+	glm::vec2 scaleEnd;
+	glm::vec2 scale;
+	float currentLife;
+	float totalLife;
+};
+
+static_assert(sizeof(gpu_particle) == 96, "gpu_particle must match the std430 layout");
+
+struct gpu_spawn_attributes
+{
+	glm::vec2 origin;
+	glm::vec2 speed;
+	float life;
+	float padding;
+};
+
+// GL 4.3 backend that keeps particle state in SSBOs and runs the update,
+// death and spawning as compute shaders. Survivors and new particles are
+// appended to the other state buffer through an atomic counter, and a one
+// thread pass turns that counter into indirect draw/dispatch arguments, so
+// the alive count never travels back to the CPU.
+//
+// Emission timing, randomization and settings come from the emitter, whose
+// CPU columns are left untouched. particle_system stays the reference.
+struct particle_compute_system
+{
+	// False when the context is older than GL 4.3
+	bool Init(particle_system& emitter);
+	void Update(timestep ts);
+	// Draws each particle rewindSeconds before its current state. Motion is
+	// linear here, so that is the same as interpolating between updates
+	void Render(float rewindSeconds = 0.0f);
+
+	void ParticleBurst(unsigned int nrParticles);
+	void ClearParticles();
+
+	// Blocking readback for debugging and CPU/GPU comparisons
+	void ReadBackParticles(std::vector<gpu_particle>& out);
+
+	particle_system* emitter = nullptr;
+	int totalParticles = 0;
+	int srcSlot = 0;
+
+	std::vector<gpu_spawn_attributes> spawnStaging;
+
+	GLuint VAO, VBO, EBO;
+	GLuint STATE_SSBO[2], COUNTER_SSBO, SPAWN_SSBO, COMMAND_BUFFER;
+
+	std::unique_ptr<Shader> updateShader;
+	std::unique_ptr<Shader> spawnShader;
+	std::unique_ptr<Shader> finalizeShader;
+	std::unique_ptr<Shader> renderShader;
+	camera_buffer camera;
+
+private:
+	void Spawn(int slot, int count, float oldestAge, float ageStep);
+	void Finalize(int slot);
+};
@@ -0,0 +1,202 @@
+#include "particle_instance.h"
+
+#include "particle_system.h"
+#include "profiler.h"
+
+#include <vector>
+
+// Particles culled per batch, the visible indices of one stay on the stack
+#define CULL_BATCH_SIZE 256
+
+// The framebuffer clamps colors to [0, 1] anyway, so nothing is lost by
+// doing it here
+static inline uint32_t PackColor(const glm::vec4& color)
+{
+    uint32_t packed = 0;
+    for (int k = 0; k < 4; k++) {
+        float c = color[k] < 0.0f ? 0.0f : (color[k] > 1.0f ? 1.0f : color[k]);
+        packed |= (uint32_t)(c * 255.0f + 0.5f) << (8 * k);
+    }
+    return packed;
+}
+
+// Atlas cell of particle i, from its normalized age
+template <bool Sprite>
+static inline uint32_t FrameOf(const particle_system& particleSystem, int i)
+{
+    if (!Sprite) {
+        return PARTICLE_NO_SPRITE;
+    }
+    float age = 1.0f - particleSystem.currentLife[i] * particleSystem.inverseLife[i];
+    return FlipbookFrame(particleSystem.flipbook, age);
+}
+
+// Depth and Sprite are fixed per instantiation, so 2D emitters without
+// sprites carry neither z nor the frame lookup
+template <bool Depth, bool Sprite>
+static void WriteInstancesFor(const particle_system& particleSystem, particle_instance* dst, int count, float alpha)
+{
+    const glm::vec2* position     = particleSystem.position;
+    const glm::vec2* prevPosition = particleSystem.prevPosition;
+    const glm::vec2* scale        = particleSystem.scale;
+    const glm::vec4* color        = particleSystem.color;
+    const float* positionZ        = particleSystem.positionZ;
+    const float* prevPositionZ    = particleSystem.prevPositionZ;
+    if (alpha >= 1.0f) {
+        for (int i = 0; i < count; i++) {
+            dst[i].position = glm::vec3(position[i], Depth ? positionZ[i] : 0.0f);
+            dst[i].scale    = scale[i];
+            dst[i].color    = PackColor(color[i]);
+            dst[i].frame    = FrameOf<Sprite>(particleSystem, i);
+        }
+    }
+    else {
+        for (int i = 0; i < count; i++) {
+            glm::vec2 xy = prevPosition[i] + (position[i] - prevPosition[i]) * alpha;
+            float z      = Depth ? prevPositionZ[i] + (positionZ[i] - prevPositionZ[i]) * alpha : 0.0f;
+            dst[i].position = glm::vec3(xy, z);
+            dst[i].scale    = scale[i];
+            dst[i].color    = PackColor(color[i]);
+            dst[i].frame    = FrameOf<Sprite>(particleSystem, i);
+        }
+    }
+}
+
+// The renderer passes its mapped ring region here, so only the
+// glBufferSubData fallback goes through a staging copy
+void WriteInstances(const particle_system& particleSystem, particle_instance* dst, int count, float alpha)
+{
+    PROFILE_SCOPE("Write instances");
+    bool sprite = particleSystem.flipbook.frameCount > 0;
+    if (particleSystem.space == SPACE_3D) {
+        (sprite ? WriteInstancesFor<true, true> : WriteInstancesFor<true, false>)(particleSystem, dst, count, alpha);
+    }
+    else {
+        (sprite ? WriteInstancesFor<false, true> : WriteInstancesFor<false, false>)(particleSystem, dst, count, alpha);
+    }
+}
+
+// The quad spans position +- scale / 2, see the vertices in particle_renderer
+static inline bool IsVisible(glm::vec3 position, glm::vec2 scale, float life, const view_bounds& view)
+{
+    glm::vec2 half = glm::abs(scale) * 0.5f;
+    return (life > 0.0f) &
+        (position.x + half.x >= view.min.x) & (position.x - half.x <= view.max.x) &
+        (position.y + half.y >= view.min.y) & (position.y - half.y <= view.max.y);
+}
+
+// A camera facing quad turns with the view, so it is tested as the disc
+// through its corners
+static inline bool IsVisibleInFrustum(glm::vec3 position, glm::vec2 scale, float life, const view_bounds& view)
+{
+    float radius = 0.5f * glm::length(scale);
+    bool inside = life > 0.0f;
+    for (int k = 0; k < 6; k++) {
+        inside &= glm::dot(glm::vec3(view.planes[k]), position) + view.planes[k].w >= -radius;
+    }
+    return inside;
+}
+
+void SetFrustum(view_bounds& view, const glm::mat4& viewProjection)
+{
+    // Rows of the matrix, glm stores columns
+    glm::vec4 row[4];
+    for (int r = 0; r < 4; r++) {
+        row[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+    }
+
+    for (int axis = 0; axis < 3; axis++) {
+        view.planes[2 * axis]     = row[3] + row[axis];
+        view.planes[2 * axis + 1] = row[3] - row[axis];
+    }
+    // Unit normals, so the plane distance compares to a radius
+    for (glm::vec4& plane : view.planes) {
+        plane = plane / glm::length(glm::vec3(plane));
+    }
+}
+
+template <bool Depth, bool Sprite>
+static int WriteVisibleInstancesFor(const particle_system& particleSystem, particle_instance* dst, int count, float alpha,
+    const view_bounds& view, job_system* jobSystem)
+{
+    const glm::vec2* position     = particleSystem.position;
+    const glm::vec2* prevPosition = particleSystem.prevPosition;
+    const glm::vec2* scale        = particleSystem.scale;
+    const glm::vec4* color        = particleSystem.color;
+    const float* life             = particleSystem.currentLife;
+    const float* positionZ        = particleSystem.positionZ;
+    const float* prevPositionZ    = particleSystem.prevPositionZ;
+
+    auto at = [&](int i) {
+        if (alpha >= 1.0f) {
+            return glm::vec3(position[i], Depth ? positionZ[i] : 0.0f);
+        }
+        glm::vec2 xy = prevPosition[i] + (position[i] - prevPosition[i]) * alpha;
+        float z      = Depth ? prevPositionZ[i] + (positionZ[i] - prevPositionZ[i]) * alpha : 0.0f;
+        return glm::vec3(xy, z);
+    };
+    auto visible = [&](int i) {
+        return Depth ? IsVisibleInFrustum(at(i), scale[i], life[i], view) : IsVisible(at(i), scale[i], life[i], view);
+    };
+
+    // Writes the visible particles of [begin, end) from dst[out] on. A
+    // branch per particle mispredicts half the time when an effect straddles
+    // the view edge, so each batch first collects the visible indices with
+    // only the cursor depending on the test, then writes them
+    auto write = [&](int begin, int end, int out) {
+        int indices[CULL_BATCH_SIZE];
+        for (int batch = begin; batch < end; batch += CULL_BATCH_SIZE) {
+            int last = end - batch < CULL_BATCH_SIZE ? end : batch + CULL_BATCH_SIZE;
+            int n = 0;
+            for (int i = batch; i < last; i++) {
+                indices[n] = i;
+                n += visible(i);
+            }
+            for (int k = 0; k < n; k++) {
+                int i = indices[k];
+                dst[out + k].position = at(i);
+                dst[out + k].scale    = scale[i];
+                dst[out + k].color    = PackColor(color[i]);
+                dst[out + k].frame    = FrameOf<Sprite>(particleSystem, i);
+            }
+            out += n;
+        }
+        return out;
+    };
+
+    // One pass is enough when nothing runs in parallel
+    if (!jobSystem || jobSystem->GetThreadCount() <= 1 || count <= UPDATE_CHUNK_SIZE) {
+        return write(0, count, 0);
+    }
+
+    int chunks = (count + UPDATE_CHUNK_SIZE - 1) / UPDATE_CHUNK_SIZE;
+    std::vector<int> offsets(chunks + 1);
+    jobSystem->ParallelFor(count, UPDATE_CHUNK_SIZE, [&](int begin, int end) {
+        int survivors = 0;
+        for (int i = begin; i < end; i++) {
+            survivors += visible(i);
+        }
+        offsets[begin / UPDATE_CHUNK_SIZE + 1] = survivors;
+    });
+
+    offsets[0] = 0;
+    for (int c = 0; c < chunks; c++) {
+        offsets[c + 1] += offsets[c];
+    }
+
+    jobSystem->ParallelFor(count, UPDATE_CHUNK_SIZE, [&](int begin, int end) {
+        write(begin, end, offsets[begin / UPDATE_CHUNK_SIZE]);
+    });
+    return offsets[chunks];
+}
+
+int WriteVisibleInstances(const particle_system& particleSystem, particle_instance* dst, int count, float alpha,
+    const view_bounds& view, job_system* jobSystem)
+{
+    PROFILE_SCOPE("Cull instances");
+    bool sprite = particleSystem.flipbook.frameCount > 0;
+    if (particleSystem.space == SPACE_3D) {
+        return (sprite ? WriteVisibleInstancesFor<true, true> : WriteVisibleInstancesFor<true, false>)(particleSystem, dst, count, alpha, view, jobSystem);
+    }
+    return (sprite ? WriteVisibleInstancesFor<false, true> : WriteVisibleInstancesFor<false, false>)(particleSystem, dst, count, alpha, view, jobSystem);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+struct particle_system;
+struct job_system;
+
+// What the camera sees. 2D emitters are tested against the world space
+// rectangle, 3D ones against the frustum planes
+struct view_bounds
+{
+	glm::vec2 min;
+	glm::vec2 max;
+	// Normals point inside, w is the offset. The default passes everything
+	glm::vec4 planes[6] = {
+		glm::vec4(0, 0, 0, 1), glm::vec4(0, 0, 0, 1), glm::vec4(0, 0, 0, 1),
+		glm::vec4(0, 0, 0, 1), glm::vec4(0, 0, 0, 1), glm::vec4(0, 0, 0, 1)
+	};
+};
+
+// Extracts view.planes from a projection * view matrix
+void SetFrustum(view_bounds& view, const glm::mat4& viewProjection);
+
+// 28 bytes per instance, the vertex shader builds the camera facing quad
+// from position and scale. z stays 0 for 2D emitters
+struct particle_instance
+{
+	glm::vec3 position;
+	glm::vec2 scale;
+	uint32_t color; // RGBA8, R in the lowest byte
+	uint32_t frame; // Atlas cell, or PARTICLE_NO_SPRITE
+};
+
+static_assert(sizeof(particle_instance) == 28, "particle_instance must stay tightly packed");
+
+// Writes the first count particles as instances. alpha places them between
+// the last two updates, 1 writes the latest state as is. No GL involved, so
+// the headless benchmark can measure it too.
+void WriteInstances(const particle_system& particleSystem, particle_instance* dst, int count, float alpha);
+
+// Same as WriteInstances, but skips particles whose quad lies outside view
+// or whose life already ran out, and packs the rest from dst[0] in particle
+// order. Returns how many were written. Every chunk counts its survivors,
+// then writes them at its offset in the prefix sum of those counts, on
+// jobSystem when not null.
+int WriteVisibleInstances(const particle_system& particleSystem, particle_instance* dst, int count, float alpha,
+	const view_bounds& view, job_system* jobSystem = nullptr);
@@ -0,0 +1,691 @@
+#include "particle_kernels.h"
+#include "particle_lut.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define PARTICLES_X86 1
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #endif
+#else
+    #define PARTICLES_X86 0
+#endif
+
+// AVX-512 implies FMA, and a fused multiply-add would make that path round
+// differently from the others
+#if defined(__clang__)
+    #pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+    #pragma GCC optimize("fp-contract=off")
+#endif
+
+// MSVC exposes every intrinsic unconditionally, GCC/Clang need the ISA
+// enabled per function so the rest of the file stays baseline x86
+#if PARTICLES_X86 && !defined(_MSC_VER)
+    #define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+    #define SIMD_TARGET(isa)
+#endif
+
+// Features is a mask of update_feature. The tests on it are constant, so
+// each instantiation only contains the lerps it asked for.
+template <int Features>
+static void UpdateScalar(const particle_columns& c, int begin, int end, float delta)
+{
+    for (int i = begin; i < end; i++) {
+        float life = c.currentLife[i] - delta;
+        float t    = life / c.totalLife[i];
+
+        c.currentLife[i] = life;
+        c.prevPosition[i] = c.position[i];
+        c.position[i].x += c.speed[i].x * delta;
+        c.position[i].y += c.speed[i].y * delta;
+
+        // Same as glm::mix(end, begin, t), written the way the SIMD paths evaluate it
+        if (Features & UPDATE_COLOR) {
+            for (int k = 0; k < 4; k++) {
+                c.color[i][k] = c.colorEnd[i][k] + (c.colorBegin[i][k] - c.colorEnd[i][k]) * t;
+            }
+        }
+        if (Features & UPDATE_SCALE) {
+            for (int k = 0; k < 2; k++) {
+                c.scale[i][k] = c.scaleEnd[i][k] + (c.scaleBegin[i][k] - c.scaleEnd[i][k]) * t;
+            }
+        }
+    }
+}
+
+// UPDATE_LUT: the normalized age takes a multiply by the stored reciprocal
+// instead of a divide, and color and scale are two table reads instead of
+// lerps over 48 bytes of begin/end columns.
+static void UpdateLutScalar(const particle_columns& c, int begin, int end, float delta)
+{
+    const particle_lut& lut = *c.lut;
+    for (int i = begin; i < end; i++) {
+        float life = c.currentLife[i] - delta;
+        float age  = 1.0f - life * c.inverseLife[i];
+
+        c.currentLife[i] = life;
+        c.age[i] = age;
+        c.prevPosition[i] = c.position[i];
+        c.position[i].x += c.speed[i].x * delta;
+        c.position[i].y += c.speed[i].y * delta;
+
+        int entry = LutIndex(age);
+        c.color[i] = lut.color[entry];
+        c.scale[i] = lut.scale[entry];
+    }
+}
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+// 2^-24, the top 24 bits of a word convert to float exactly
+#define RANDOM_UNIT (1.0f / 16777216.0f)
+
+static void PhiloxBlock(uint64_t key, uint64_t block, uint32_t stream, uint32_t out[4])
+{
+    uint32_t c0 = (uint32_t)block, c1 = (uint32_t)(block >> 32), c2 = stream, c3 = 0;
+    uint32_t k0 = (uint32_t)key, k1 = (uint32_t)(key >> 32);
+
+    for (int round = 0; round < 10; round++) {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c0 = n0;
+        c1 = (uint32_t)p1;
+        c2 = n2;
+        c3 = (uint32_t)p0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+static void FillRandomScalar(uint64_t key, uint32_t stream, uint64_t first, int count, float lo, float hi, float* out)
+{
+    float range = hi - lo;
+    uint32_t words[4];
+    for (int i = 0; i < count; i++) {
+        uint64_t n = first + i;
+        if (i == 0 || (n & 3) == 0) {
+            PhiloxBlock(key, n >> 2, stream, words);
+        }
+        out[i] = lo + range * ((float)(words[n & 3] >> 8) * RANDOM_UNIT);
+    }
+}
+
+#if PARTICLES_X86
+
+template <int Features>
+SIMD_TARGET("sse4.2")
+static void UpdateSSE42(const particle_columns& c, int begin, int end, float delta)
+{
+    const __m128 d = _mm_set1_ps(delta);
+
+    float* position         = (float*)c.position;
+    float* prevPosition     = (float*)c.prevPosition;
+    const float* speed      = (const float*)c.speed;
+    float* color            = (float*)c.color;
+    const float* colorBegin = (const float*)c.colorBegin;
+    const float* colorEnd   = (const float*)c.colorEnd;
+    float* scale            = (float*)c.scale;
+    const float* scaleBegin = (const float*)c.scaleBegin;
+    const float* scaleEnd   = (const float*)c.scaleEnd;
+
+    int i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 life = _mm_sub_ps(_mm_loadu_ps(c.currentLife + i), d);
+        __m128 t    = _mm_div_ps(life, _mm_loadu_ps(c.totalLife + i));
+        _mm_storeu_ps(c.currentLife + i, life);
+
+        for (int k = 0; k < 2; k++) {
+            int offset = 2 * i + 4 * k;
+            __m128 p = _mm_loadu_ps(position + offset);
+            _mm_storeu_ps(prevPosition + offset, p);
+            _mm_storeu_ps(position + offset, _mm_add_ps(p, _mm_mul_ps(_mm_loadu_ps(speed + offset), d)));
+        }
+
+        // vec2 scale: two particles per register
+        if (Features & UPDATE_SCALE) {
+            __m128 tScale[2] = { _mm_unpacklo_ps(t, t), _mm_unpackhi_ps(t, t) };
+            for (int k = 0; k < 2; k++) {
+                int offset = 2 * i + 4 * k;
+                __m128 e = _mm_loadu_ps(scaleEnd + offset);
+                __m128 b = _mm_loadu_ps(scaleBegin + offset);
+                _mm_storeu_ps(scale + offset, _mm_add_ps(e, _mm_mul_ps(_mm_sub_ps(b, e), tScale[k])));
+            }
+        }
+
+        // vec4 color: one particle per register
+        if (Features & UPDATE_COLOR) {
+            __m128 tColor[4] = {
+                _mm_shuffle_ps(t, t, _MM_SHUFFLE(0, 0, 0, 0)),
+                _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 1, 1, 1)),
+                _mm_shuffle_ps(t, t, _MM_SHUFFLE(2, 2, 2, 2)),
+                _mm_shuffle_ps(t, t, _MM_SHUFFLE(3, 3, 3, 3))
+            };
+            for (int k = 0; k < 4; k++) {
+                int offset = 4 * i + 4 * k;
+                __m128 e = _mm_loadu_ps(colorEnd + offset);
+                __m128 b = _mm_loadu_ps(colorBegin + offset);
+                _mm_storeu_ps(color + offset, _mm_add_ps(e, _mm_mul_ps(_mm_sub_ps(b, e), tColor[k])));
+            }
+        }
+    }
+
+    UpdateScalar<Features>(c, i, end, delta);
+}
+
+template <int Features>
+SIMD_TARGET("avx2")
+static void UpdateAVX2(const particle_columns& c, int begin, int end, float delta)
+{
+    const __m256 d = _mm256_set1_ps(delta);
+
+    // Lane i of t is spread over the components of particle i
+    const __m256i scaleIdx[2] = {
+        _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3),
+        _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7)
+    };
+    const __m256i colorIdx[4] = {
+        _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1),
+        _mm256_setr_epi32(2, 2, 2, 2, 3, 3, 3, 3),
+        _mm256_setr_epi32(4, 4, 4, 4, 5, 5, 5, 5),
+        _mm256_setr_epi32(6, 6, 6, 6, 7, 7, 7, 7)
+    };
+
+    float* position         = (float*)c.position;
+    float* prevPosition     = (float*)c.prevPosition;
+    const float* speed      = (const float*)c.speed;
+    float* color            = (float*)c.color;
+    const float* colorBegin = (const float*)c.colorBegin;
+    const float* colorEnd   = (const float*)c.colorEnd;
+    float* scale            = (float*)c.scale;
+    const float* scaleBegin = (const float*)c.scaleBegin;
+    const float* scaleEnd   = (const float*)c.scaleEnd;
+
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 life = _mm256_sub_ps(_mm256_loadu_ps(c.currentLife + i), d);
+        __m256 t    = _mm256_div_ps(life, _mm256_loadu_ps(c.totalLife + i));
+        _mm256_storeu_ps(c.currentLife + i, life);
+
+        for (int k = 0; k < 2; k++) {
+            int offset = 2 * i + 8 * k;
+            __m256 p = _mm256_loadu_ps(position + offset);
+            _mm256_storeu_ps(prevPosition + offset, p);
+            _mm256_storeu_ps(position + offset, _mm256_add_ps(p, _mm256_mul_ps(_mm256_loadu_ps(speed + offset), d)));
+        }
+
+        if (Features & UPDATE_SCALE) {
+            for (int k = 0; k < 2; k++) {
+                int offset = 2 * i + 8 * k;
+                __m256 e = _mm256_loadu_ps(scaleEnd + offset);
+                __m256 b = _mm256_loadu_ps(scaleBegin + offset);
+                __m256 s = _mm256_permutevar8x32_ps(t, scaleIdx[k]);
+                _mm256_storeu_ps(scale + offset, _mm256_add_ps(e, _mm256_mul_ps(_mm256_sub_ps(b, e), s)));
+            }
+        }
+
+        if (Features & UPDATE_COLOR) {
+            for (int k = 0; k < 4; k++) {
+                int offset = 4 * i + 8 * k;
+                __m256 e = _mm256_loadu_ps(colorEnd + offset);
+                __m256 b = _mm256_loadu_ps(colorBegin + offset);
+                __m256 s = _mm256_permutevar8x32_ps(t, colorIdx[k]);
+                _mm256_storeu_ps(color + offset, _mm256_add_ps(e, _mm256_mul_ps(_mm256_sub_ps(b, e), s)));
+            }
+        }
+    }
+
+    // GCC does not insert vzeroupper in target() functions, and a dirty
+    // upper state makes all SSE code that runs after this much slower
+    _mm256_zeroupper();
+    UpdateScalar<Features>(c, i, end, delta);
+}
+
+template <int Features>
+SIMD_TARGET("avx512f")
+static void UpdateAVX512(const particle_columns& c, int begin, int end, float delta)
+{
+    const __m512 d = _mm512_set1_ps(delta);
+
+    const __m512i scaleIdx[2] = {
+        _mm512_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7),
+        _mm512_setr_epi32(8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15)
+    };
+    const __m512i colorIdx[4] = {
+        _mm512_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3),
+        _mm512_setr_epi32(4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7),
+        _mm512_setr_epi32(8, 8, 8, 8, 9, 9, 9, 9, 10, 10, 10, 10, 11, 11, 11, 11),
+        _mm512_setr_epi32(12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15)
+    };
+
+    float* position         = (float*)c.position;
+    float* prevPosition     = (float*)c.prevPosition;
+    const float* speed      = (const float*)c.speed;
+    float* color            = (float*)c.color;
+    const float* colorBegin = (const float*)c.colorBegin;
+    const float* colorEnd   = (const float*)c.colorEnd;
+    float* scale            = (float*)c.scale;
+    const float* scaleBegin = (const float*)c.scaleBegin;
+    const float* scaleEnd   = (const float*)c.scaleEnd;
+
+    int i = begin;
+    for (; i + 16 <= end; i += 16) {
+        __m512 life = _mm512_sub_ps(_mm512_loadu_ps(c.currentLife + i), d);
+        __m512 t    = _mm512_div_ps(life, _mm512_loadu_ps(c.totalLife + i));
+        _mm512_storeu_ps(c.currentLife + i, life);
+
+        for (int k = 0; k < 2; k++) {
+            int offset = 2 * i + 16 * k;
+            __m512 p = _mm512_loadu_ps(position + offset);
+            _mm512_storeu_ps(prevPosition + offset, p);
+            _mm512_storeu_ps(position + offset, _mm512_add_ps(p, _mm512_mul_ps(_mm512_loadu_ps(speed + offset), d)));
+        }
+
+        if (Features & UPDATE_SCALE) {
+            for (int k = 0; k < 2; k++) {
+                int offset = 2 * i + 16 * k;
+                __m512 e = _mm512_loadu_ps(scaleEnd + offset);
+                __m512 b = _mm512_loadu_ps(scaleBegin + offset);
+                __m512 s = _mm512_permutexvar_ps(scaleIdx[k], t);
+                _mm512_storeu_ps(scale + offset, _mm512_add_ps(e, _mm512_mul_ps(_mm512_sub_ps(b, e), s)));
+            }
+        }
+
+        if (Features & UPDATE_COLOR) {
+            for (int k = 0; k < 4; k++) {
+                int offset = 4 * i + 16 * k;
+                __m512 e = _mm512_loadu_ps(colorEnd + offset);
+                __m512 b = _mm512_loadu_ps(colorBegin + offset);
+                __m512 s = _mm512_permutexvar_ps(colorIdx[k], t);
+                _mm512_storeu_ps(color + offset, _mm512_add_ps(e, _mm512_mul_ps(_mm512_sub_ps(b, e), s)));
+            }
+        }
+    }
+
+    _mm256_zeroupper();
+    UpdateScalar<Features>(c, i, end, delta);
+}
+
+// The age math and the table index are vectorized, then every particle
+// copies its entries, paired up so the stores stay full width
+SIMD_TARGET("sse4.2")
+static void UpdateLutSSE42(const particle_columns& c, int begin, int end, float delta)
+{
+    const __m128 d     = _mm_set1_ps(delta);
+    const __m128 one   = _mm_set1_ps(1.0f);
+    const __m128 half  = _mm_set1_ps(0.5f);
+    const __m128 zero  = _mm_setzero_ps();
+    const __m128 steps = _mm_set1_ps((float)(PARTICLE_LUT_SIZE - 1));
+
+    const float* lutColor = (const float*)c.lut->color;
+    const float* lutScale = (const float*)c.lut->scale;
+    float* position     = (float*)c.position;
+    float* prevPosition = (float*)c.prevPosition;
+    const float* speed  = (const float*)c.speed;
+    float* color        = (float*)c.color;
+    float* scale        = (float*)c.scale;
+    alignas(16) int entry[4];
+
+    int i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 life = _mm_sub_ps(_mm_loadu_ps(c.currentLife + i), d);
+        __m128 age  = _mm_sub_ps(one, _mm_mul_ps(life, _mm_loadu_ps(c.inverseLife + i)));
+        _mm_storeu_ps(c.currentLife + i, life);
+        _mm_storeu_ps(c.age + i, age);
+
+        for (int k = 0; k < 2; k++) {
+            int offset = 2 * i + 4 * k;
+            __m128 p = _mm_loadu_ps(position + offset);
+            _mm_storeu_ps(prevPosition + offset, p);
+            _mm_storeu_ps(position + offset, _mm_add_ps(p, _mm_mul_ps(_mm_loadu_ps(speed + offset), d)));
+        }
+
+        // Same clamp as LutIndex, max returns zero for a NaN age like it does
+        __m128 f = _mm_add_ps(_mm_mul_ps(age, steps), half);
+        f = _mm_min_ps(_mm_max_ps(f, zero), steps);
+        _mm_store_si128((__m128i*)entry, _mm_cvttps_epi32(f));
+        for (int k = 0; k < 4; k++) {
+            _mm_storeu_ps(color + 4 * (i + k), _mm_loadu_ps(lutColor + 4 * entry[k]));
+        }
+        for (int k = 0; k < 4; k += 2) {
+            __m128 pair = _mm_castpd_ps(_mm_load_sd((const double*)(lutScale + 2 * entry[k])));
+            pair = _mm_loadh_pi(pair, (const __m64*)(lutScale + 2 * entry[k + 1]));
+            _mm_storeu_ps(scale + 2 * (i + k), pair);
+        }
+    }
+
+    UpdateLutScalar(c, i, end, delta);
+}
+
+// Also serves AVX-512, the table reads cost the same at any width
+SIMD_TARGET("avx2")
+static void UpdateLutAVX2(const particle_columns& c, int begin, int end, float delta)
+{
+    const __m256 d     = _mm256_set1_ps(delta);
+    const __m256 one   = _mm256_set1_ps(1.0f);
+    const __m256 half  = _mm256_set1_ps(0.5f);
+    const __m256 zero  = _mm256_setzero_ps();
+    const __m256 steps = _mm256_set1_ps((float)(PARTICLE_LUT_SIZE - 1));
+
+    const float* lutColor = (const float*)c.lut->color;
+    const float* lutScale = (const float*)c.lut->scale;
+    float* position     = (float*)c.position;
+    float* prevPosition = (float*)c.prevPosition;
+    const float* speed  = (const float*)c.speed;
+    float* color        = (float*)c.color;
+    float* scale        = (float*)c.scale;
+    alignas(32) int entry[8];
+
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 life = _mm256_sub_ps(_mm256_loadu_ps(c.currentLife + i), d);
+        __m256 age  = _mm256_sub_ps(one, _mm256_mul_ps(life, _mm256_loadu_ps(c.inverseLife + i)));
+        _mm256_storeu_ps(c.currentLife + i, life);
+        _mm256_storeu_ps(c.age + i, age);
+
+        for (int k = 0; k < 2; k++) {
+            int offset = 2 * i + 8 * k;
+            __m256 p = _mm256_loadu_ps(position + offset);
+            _mm256_storeu_ps(prevPosition + offset, p);
+            _mm256_storeu_ps(position + offset, _mm256_add_ps(p, _mm256_mul_ps(_mm256_loadu_ps(speed + offset), d)));
+        }
+
+        __m256 f = _mm256_add_ps(_mm256_mul_ps(age, steps), half);
+        f = _mm256_min_ps(_mm256_max_ps(f, zero), steps);
+        _mm256_store_si256((__m256i*)entry, _mm256_cvttps_epi32(f));
+
+        for (int k = 0; k < 8; k += 2) {
+            __m128 first  = _mm_loadu_ps(lutColor + 4 * entry[k]);
+            __m128 second = _mm_loadu_ps(lutColor + 4 * entry[k + 1]);
+            _mm256_storeu_ps(color + 4 * (i + k), _mm256_insertf128_ps(_mm256_castps128_ps256(first), second, 1));
+        }
+        for (int k = 0; k < 8; k += 4) {
+            __m128 low  = _mm_castpd_ps(_mm_load_sd((const double*)(lutScale + 2 * entry[k])));
+            __m128 high = _mm_castpd_ps(_mm_load_sd((const double*)(lutScale + 2 * entry[k + 2])));
+            low  = _mm_loadh_pi(low, (const __m64*)(lutScale + 2 * entry[k + 1]));
+            high = _mm_loadh_pi(high, (const __m64*)(lutScale + 2 * entry[k + 3]));
+            _mm256_storeu_ps(scale + 2 * (i + k), _mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1));
+        }
+    }
+
+    _mm256_zeroupper();
+    UpdateLutScalar(c, i, end, delta);
+}
+
+// The SIMD fills run one Philox block per 32 bit lane, then transpose so
+// the four words of each block land next to each other. The unaligned head
+// and the tail go through the scalar path.
+SIMD_TARGET("sse4.2")
+static __m128i MulHiLo(__m128i a, __m128i m, __m128i& lo)
+{
+    __m128i even = _mm_mul_epu32(a, m);
+    __m128i odd  = _mm_mul_epu32(_mm_srli_epi64(a, 32), m);
+    lo = _mm_blend_epi16(even, _mm_slli_epi64(odd, 32), 0xCC);
+    return _mm_blend_epi16(_mm_srli_epi64(even, 32), odd, 0xCC);
+}
+
+SIMD_TARGET("sse4.2")
+static void FillRandomSSE42(uint64_t key, uint32_t stream, uint64_t first, int count, float lo, float hi, float* out)
+{
+    int head = (int)((4 - (first & 3)) & 3);
+    head = head < count ? head : count;
+    FillRandomScalar(key, stream, first, head, lo, hi, out);
+
+    const __m128i m0 = _mm_set1_epi32((int)PHILOX_M0);
+    const __m128i m1 = _mm_set1_epi32((int)PHILOX_M1);
+    const __m128 vlo = _mm_set1_ps(lo);
+    const __m128 range = _mm_set1_ps(hi - lo);
+    const __m128 unit = _mm_set1_ps(RANDOM_UNIT);
+
+    int i = head;
+    for (; i + 16 <= count; i += 16) {
+        uint64_t block = (first + i) >> 2;
+        __m128i c0 = _mm_add_epi32(_mm_set1_epi32((int)(uint32_t)block), _mm_setr_epi32(0, 1, 2, 3));
+        // Carry into the high word for blocks that wrap the low one
+        __m128i c1 = _mm_sub_epi32(_mm_set1_epi32((int)(uint32_t)(block >> 32)),
+                                   _mm_cmplt_epi32(_mm_xor_si128(c0, _mm_set1_epi32((int)0x80000000)),
+                                                   _mm_set1_epi32((int)((uint32_t)block ^ 0x80000000u))));
+        __m128i c2 = _mm_set1_epi32((int)stream);
+        __m128i c3 = _mm_setzero_si128();
+        uint32_t k0 = (uint32_t)key, k1 = (uint32_t)(key >> 32);
+
+        for (int round = 0; round < 10; round++) {
+            __m128i lo0, lo1;
+            __m128i hi0 = MulHiLo(c0, m0, lo0);
+            __m128i hi1 = MulHiLo(c2, m1, lo1);
+            c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), _mm_set1_epi32((int)k0));
+            c1 = lo1;
+            c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), _mm_set1_epi32((int)k1));
+            c3 = lo0;
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+
+        __m128i t0 = _mm_unpacklo_epi32(c0, c1);
+        __m128i t1 = _mm_unpacklo_epi32(c2, c3);
+        __m128i t2 = _mm_unpackhi_epi32(c0, c1);
+        __m128i t3 = _mm_unpackhi_epi32(c2, c3);
+        __m128i words[4] = {
+            _mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1),
+            _mm_unpacklo_epi64(t2, t3), _mm_unpackhi_epi64(t2, t3)
+        };
+        for (int k = 0; k < 4; k++) {
+            __m128 u = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(words[k], 8)), unit);
+            _mm_storeu_ps(out + i + 4 * k, _mm_add_ps(vlo, _mm_mul_ps(range, u)));
+        }
+    }
+
+    FillRandomScalar(key, stream, first + i, count - i, lo, hi, out + i);
+}
+
+SIMD_TARGET("avx2")
+static __m256i MulHiLo(__m256i a, __m256i m, __m256i& lo)
+{
+    __m256i even = _mm256_mul_epu32(a, m);
+    __m256i odd  = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+    lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+    return _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+}
+
+SIMD_TARGET("avx2")
+static void FillRandomAVX2(uint64_t key, uint32_t stream, uint64_t first, int count, float lo, float hi, float* out)
+{
+    int head = (int)((4 - (first & 3)) & 3);
+    head = head < count ? head : count;
+    FillRandomScalar(key, stream, first, head, lo, hi, out);
+
+    const __m256i m0 = _mm256_set1_epi32((int)PHILOX_M0);
+    const __m256i m1 = _mm256_set1_epi32((int)PHILOX_M1);
+    const __m256 vlo = _mm256_set1_ps(lo);
+    const __m256 range = _mm256_set1_ps(hi - lo);
+    const __m256 unit = _mm256_set1_ps(RANDOM_UNIT);
+
+    int i = head;
+    for (; i + 32 <= count; i += 32) {
+        uint64_t block = (first + i) >> 2;
+        __m256i c0 = _mm256_add_epi32(_mm256_set1_epi32((int)(uint32_t)block), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        __m256i c1 = _mm256_sub_epi32(_mm256_set1_epi32((int)(uint32_t)(block >> 32)),
+                                      _mm256_cmpgt_epi32(_mm256_set1_epi32((int)((uint32_t)block ^ 0x80000000u)),
+                                                         _mm256_xor_si256(c0, _mm256_set1_epi32((int)0x80000000))));
+        __m256i c2 = _mm256_set1_epi32((int)stream);
+        __m256i c3 = _mm256_setzero_si256();
+        uint32_t k0 = (uint32_t)key, k1 = (uint32_t)(key >> 32);
+
+        for (int round = 0; round < 10; round++) {
+            __m256i lo0, lo1;
+            __m256i hi0 = MulHiLo(c0, m0, lo0);
+            __m256i hi1 = MulHiLo(c2, m1, lo1);
+            c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32((int)k0));
+            c1 = lo1;
+            c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32((int)k1));
+            c3 = lo0;
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+
+        // Per 128 bit half, as in the SSE path, then reorder the halves
+        __m256i t0 = _mm256_unpacklo_epi32(c0, c1);
+        __m256i t1 = _mm256_unpacklo_epi32(c2, c3);
+        __m256i t2 = _mm256_unpackhi_epi32(c0, c1);
+        __m256i t3 = _mm256_unpackhi_epi32(c2, c3);
+        __m256i b04 = _mm256_unpacklo_epi64(t0, t1);
+        __m256i b15 = _mm256_unpackhi_epi64(t0, t1);
+        __m256i b26 = _mm256_unpacklo_epi64(t2, t3);
+        __m256i b37 = _mm256_unpackhi_epi64(t2, t3);
+        __m256i words[4] = {
+            _mm256_permute2x128_si256(b04, b15, 0x20), _mm256_permute2x128_si256(b26, b37, 0x20),
+            _mm256_permute2x128_si256(b04, b15, 0x31), _mm256_permute2x128_si256(b26, b37, 0x31)
+        };
+        for (int k = 0; k < 4; k++) {
+            __m256 u = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(words[k], 8)), unit);
+            _mm256_storeu_ps(out + i + 8 * k, _mm256_add_ps(vlo, _mm256_mul_ps(range, u)));
+        }
+    }
+
+    // Same as the AVX update kernels, the scalar tail and whatever runs
+    // after must not pay for a dirty upper state
+    _mm256_zeroupper();
+    FillRandomScalar(key, stream, first + i, count - i, lo, hi, out + i);
+}
+
+#ifdef _MSC_VER
+static bool OSSupportsYmm()
+{
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    return osxsave && (_xgetbv(0) & 0x6) == 0x6;
+}
+
+static bool OSSupportsZmm()
+{
+    return OSSupportsYmm() && (_xgetbv(0) & 0xE6) == 0xE6;
+}
+#endif
+
+#endif // PARTICLES_X86
+
+simd_level DetectSimdLevel()
+{
+#if PARTICLES_X86 && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    bool sse42 = (info[2] & (1 << 20)) != 0;
+    bool avx2 = false, avx512 = false;
+
+    if (maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2   = (info[1] & (1 << 5)) != 0 && OSSupportsYmm();
+        avx512 = (info[1] & (1 << 16)) != 0 && OSSupportsZmm();
+    }
+
+    if (avx512) return SIMD_AVX512;
+    if (avx2)   return SIMD_AVX2;
+    if (sse42)  return SIMD_SSE42;
+    return SIMD_SCALAR;
+#elif PARTICLES_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2"))    return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse4.2"))  return SIMD_SSE42;
+    return SIMD_SCALAR;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+const char* GetSimdLevelName(simd_level level)
+{
+    switch (level) {
+        case SIMD_SSE42:  return "SSE4.2";
+        case SIMD_AVX2:   return "AVX2";
+        case SIMD_AVX512: return "AVX-512";
+        default:          return "Scalar";
+    }
+}
+
+// One instantiation per simd_level and update_feature mask
+#define UPDATE_KERNEL_SET(kernel) { kernel<0>, kernel<UPDATE_COLOR>, kernel<UPDATE_SCALE>, kernel<UPDATE_ALL> }
+
+static const particle_update_kernel s_UpdateKernels[][UPDATE_ALL + 1] = {
+    UPDATE_KERNEL_SET(UpdateScalar),
+#if PARTICLES_X86
+    UPDATE_KERNEL_SET(UpdateSSE42),
+    UPDATE_KERNEL_SET(UpdateAVX2),
+    UPDATE_KERNEL_SET(UpdateAVX512),
+#endif
+};
+
+static const particle_update_kernel s_LutKernels[] = {
+    UpdateLutScalar,
+#if PARTICLES_X86
+    UpdateLutSSE42,
+    UpdateLutAVX2,
+    UpdateLutAVX2,
+#endif
+};
+
+particle_update_kernel GetUpdateKernel(simd_level level, int features)
+{
+    // Never hand out a kernel the CPU can't run
+    if (level > DetectSimdLevel()) {
+        level = DetectSimdLevel();
+    }
+
+    if (features & UPDATE_LUT) {
+        return s_LutKernels[level];
+    }
+    return s_UpdateKernels[level][features & UPDATE_ALL];
+}
+
+const char* GetUpdateFeatureName(int features)
+{
+    if (features & UPDATE_LUT) {
+        return "lifetime LUT";
+    }
+    switch (features & UPDATE_ALL) {
+        case UPDATE_COLOR: return "color";
+        case UPDATE_SCALE: return "scale";
+        case UPDATE_ALL:   return "color + scale";
+        default:           return "position only";
+    }
+}
+
+// One float per column, simple enough that the baseline auto-vectorized
+// loop is as fast as it gets
+void IntegrateDepth(const particle_columns& c, int begin, int end, float delta)
+{
+    for (int i = begin; i < end; i++) {
+        c.prevPositionZ[i] = c.positionZ[i];
+        c.positionZ[i]    += c.speedZ[i] * delta;
+    }
+}
+
+random_fill_kernel GetRandomFillKernel(simd_level level)
+{
+    if (level > DetectSimdLevel()) {
+        level = DetectSimdLevel();
+    }
+
+#if PARTICLES_X86
+    // AVX-512 has no wider win here than AVX2 at spawn batch sizes
+    switch (level) {
+        case SIMD_SSE42:  return FillRandomSSE42;
+        case SIMD_AVX2:
+        case SIMD_AVX512: return FillRandomAVX2;
+        default:          break;
+    }
+#endif
+    return FillRandomScalar;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+struct particle_lut;
+
+// Raw views over the particle columns, so the kernels don't care how
+// particle_system stores them.
+struct particle_columns
+{
+	glm::vec2* position;
+	glm::vec2* prevPosition; // position before the last update, for interpolation
+	glm::vec2* speed;
+	glm::vec4* colorBegin;
+	glm::vec4* colorEnd;
+	glm::vec4* color;
+	glm::vec2* scaleBegin;
+	glm::vec2* scaleEnd;
+	glm::vec2* scale;
+	float* currentLife;
+	float* totalLife;
+	float* age;         // normalized, only written by UPDATE_LUT kernels
+	float* inverseLife; // 1 / totalLife
+	const particle_lut* lut;
+	// Third axis of 3D emitters, see IntegrateDepth
+	float* positionZ;
+	float* prevPositionZ;
+	float* speedZ;
+};
+
+enum simd_level
+{
+	SIMD_SCALAR = 0,
+	SIMD_SSE42,
+	SIMD_AVX2,
+	SIMD_AVX512
+};
+
+// Optional work in an update kernel. A kernel built without a feature leaves
+// that output column untouched, so it is only valid while begin == end for
+// every live particle.
+enum update_feature
+{
+	UPDATE_COLOR = 0x01,
+	UPDATE_SCALE = 0x02,
+	UPDATE_ALL   = UPDATE_COLOR | UPDATE_SCALE,
+	// Color and scale sampled from columns.lut by normalized age, in place
+	// of the begin/end lerps. Overrides the other bits
+	UPDATE_LUT   = 0x04
+};
+
+// Integrates and lerps particles [begin, end). Every level performs the same
+// operations in the same order (no FMA), so results are bit-identical
+// whichever kernel runs.
+typedef void (*particle_update_kernel)(const particle_columns& columns, int begin, int end, float delta);
+
+// Moves 3D particles along z. The update kernels only cover x and y, so
+// 2D emitters never pay for the third axis
+void IntegrateDepth(const particle_columns& columns, int begin, int end, float delta);
+
+simd_level DetectSimdLevel();
+const char* GetSimdLevelName(simd_level level);
+// Looks up the kernel instantiated for level and the update_feature mask
+particle_update_kernel GetUpdateKernel(simd_level level, int features = UPDATE_ALL);
+const char* GetUpdateFeatureName(int features);
+
+// Philox4x32-10 keyed by key, counter (index / 4, stream). Writes uniform
+// floats in [lo, hi) for values [first, first + count) of stream. Value n
+// only depends on key, stream and n, and every level computes it exactly,
+// so fills can be split and batched freely.
+typedef void (*random_fill_kernel)(uint64_t key, uint32_t stream, uint64_t first, int count, float lo, float hi, float* out);
+
+random_fill_kernel GetRandomFillKernel(simd_level level);
@@ -0,0 +1,75 @@
+#include "particle_lut.h"
+
+#include <algorithm>
+
+// Index of the last key at or before age in keys sorted by age, -1 if age
+// comes before all of them
+template <typename Key>
+static int FindSegment(const std::vector<Key>& keys, float age)
+{
+    int found = -1;
+    for (size_t k = 0; k < keys.size(); k++) {
+        if (keys[k].age <= age) {
+            found = (int)k;
+        }
+    }
+    return found;
+}
+
+template <typename Key, typename Value>
+static Value EvaluateKeys(std::vector<Key> keys, float age, Value Key::* value, Value fallback)
+{
+    if (keys.empty()) {
+        return fallback;
+    }
+    std::stable_sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) { return a.age < b.age; });
+
+    int k = FindSegment(keys, age);
+    if (k < 0) {
+        return keys.front().*value;
+    }
+    if (k == (int)keys.size() - 1) {
+        return keys.back().*value;
+    }
+
+    const Key& a = keys[k];
+    const Key& b = keys[k + 1];
+    float span = b.age - a.age;
+    float t = span > 0.0f ? (age - a.age) / span : 0.0f;
+    return a.*value + (b.*value - a.*value) * t;
+}
+
+glm::vec4 particle_gradient::Evaluate(float age) const
+{
+    return EvaluateKeys(stops, age, &gradient_stop::color, glm::vec4(1.0f));
+}
+
+float particle_curve::Evaluate(float age) const
+{
+    return EvaluateKeys(keys, age, &curve_key::value, 1.0f);
+}
+
+// Runs when the curves are edited, not per frame, so the sort per lookup
+// in Evaluate doesn't matter
+void particle_lut::Bake(const particle_lifetime& lifetime, glm::vec2 scaleBegin, glm::vec2 scaleEnd)
+{
+    for (int i = 0; i < PARTICLE_LUT_SIZE; i++) {
+        float age = (float)i / (float)(PARTICLE_LUT_SIZE - 1);
+
+        glm::vec4 c = lifetime.color.Evaluate(age);
+        c.a *= lifetime.alpha.Evaluate(age);
+        color[i] = c;
+
+        float s = lifetime.scale.Evaluate(age);
+        scale[i] = scaleBegin + (scaleEnd - scaleBegin) * s;
+    }
+}
+
+particle_lifetime MakeLinearLifetime(glm::vec4 colorBegin, glm::vec4 colorEnd)
+{
+    particle_lifetime lifetime;
+    lifetime.color.stops = { { 0.0f, colorBegin }, { 1.0f, colorEnd } };
+    lifetime.alpha.keys  = { { 0.0f, 1.0f }, { 1.0f, 1.0f } };
+    lifetime.scale.keys  = { { 0.0f, 0.0f }, { 1.0f, 1.0f } };
+    return lifetime;
+}
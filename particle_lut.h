@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Entries per baked table. Particles pick the nearest one, so 256 steps
+// are finer than an 8 bit color channel
+#define PARTICLE_LUT_SIZE 256
+
+// age is normalized, 0 at spawn and 1 at death
+struct gradient_stop
+{
+	float age;
+	glm::vec4 color;
+};
+
+struct curve_key
+{
+	float age;
+	float value;
+};
+
+// Piecewise linear over age, constant past the first and last stop. The
+// stops don't have to be sorted
+struct particle_gradient
+{
+	std::vector<gradient_stop> stops;
+
+	glm::vec4 Evaluate(float age) const;
+};
+
+struct particle_curve
+{
+	std::vector<curve_key> keys;
+
+	float Evaluate(float age) const;
+};
+
+// Color and scale over a particle's life. When enabled the emitter's update
+// kernel samples the baked tables instead of lerping begin to end
+struct particle_lifetime
+{
+	bool enabled = false;
+	particle_gradient color;
+	particle_curve alpha; // multiplies the gradient's alpha
+	particle_curve scale; // 0 is the begin scale, 1 the end scale
+};
+
+struct particle_lut
+{
+	glm::vec4 color[PARTICLE_LUT_SIZE];
+	glm::vec2 scale[PARTICLE_LUT_SIZE];
+
+	void Bake(const particle_lifetime& lifetime, glm::vec2 scaleBegin, glm::vec2 scaleEnd);
+};
+
+// Table entry for a normalized age, clamped to the table. The SIMD kernels
+// compute the same with min/max, in the same order
+inline int LutIndex(float age)
+{
+	float f = age * (float)(PARTICLE_LUT_SIZE - 1) + 0.5f;
+	f = f > 0.0f ? f : 0.0f;
+	f = f < (float)(PARTICLE_LUT_SIZE - 1) ? f : (float)(PARTICLE_LUT_SIZE - 1);
+	return (int)f;
+}
+
+// Two stop gradient and linear curves, what begin/end lerping gives
+particle_lifetime MakeLinearLifetime(glm::vec4 colorBegin, glm::vec4 colorEnd);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include "particle_kernels.h"
+
+#define PARTICLE_RANDOM_DEFAULT_SEED 0x5EEDull
+
+// Independent sequences of one emitter, one per randomized attribute
+enum random_stream
+{
+	RANDOM_POSITION_X = 0,
+	RANDOM_POSITION_Y,
+	RANDOM_SPEED_X,
+	RANDOM_SPEED_Y,
+	RANDOM_LIFE,
+	RANDOM_DIRECTION_X,
+	RANDOM_DIRECTION_Y,
+	// 3D emitters only
+	RANDOM_POSITION_Z,
+	RANDOM_SPEED_Z,
+	RANDOM_DIRECTION_Z
+};
+
+// Counter-based generator: value n of a stream is a pure function of
+// (seed, stream, n), so there is no state to share between threads and a
+// particle draws the same numbers whatever batch or chunk it is spawned in.
+struct particle_random
+{
+	particle_random(uint64_t seed = PARTICLE_RANDOM_DEFAULT_SEED)
+		: seed(seed), fill(GetRandomFillKernel(DetectSimdLevel())) {};
+
+	// Uniform floats in [lo, hi) for values [first, first + count) of stream
+	inline void Fill(random_stream stream, uint64_t first, int count, float lo, float hi, float* out) const
+	{
+		fill(seed, (uint32_t)stream, first, count, lo, hi, out);
+	};
+
+	inline float Uniform(random_stream stream, uint64_t index, float lo, float hi) const
+	{
+		float value;
+		fill(seed, (uint32_t)stream, index, 1, lo, hi, &value);
+		return value;
+	};
+
+	uint64_t seed;
+	random_fill_kernel fill;
+};
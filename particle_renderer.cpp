@@ -0,0 +1,296 @@
+#include "particle_renderer.h"
+
+#include "particle_system.h"
+#include "particle_atlas.h"
+#include "window.h"
+#include "profiler.h"
+#include <cstddef>
+
+#define VERTEX_COMPONENTS 2
+#define INSTANCE_POSITION_COMPONENTS 3
+#define INSTANCE_VEC2_COMPONENTS 2
+#define COLOR_COMPONENTS  4
+#define VERTICES_PER_QUAD 4
+#define INDICES_PER_QUAD  6
+
+void particle_renderer::Init(int maxParticles, bool persistentMapping)
+{
+    totalParticles = maxParticles;
+
+    int vertexAttribIndex   = 0;
+    int positionAttribIndex = 1;
+    int scaleAttribIndex    = 2;
+    int colorAttribIndex    = 3;
+    int frameAttribIndex    = 4;
+
+    float pVerts[] = {
+        0.5f,  0.5f,
+        0.5f, -0.5f,
+       -0.5f, -0.5f,
+       -0.5f,  0.5f,
+    };
+
+    unsigned int pIndices[] = {
+        0, 1, 3,
+        1, 2, 3
+    };
+
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &EBO);
+    glGenBuffers(1, &INSTANCE_VBO);
+
+	glBindVertexArray(VAO);
+    
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(pIndices), pIndices, GL_STATIC_DRAW);
+    
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(pVerts), pVerts, GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(vertexAttribIndex);
+    glVertexAttribPointer(vertexAttribIndex,
+        VERTEX_COMPONENTS,
+        GL_FLOAT,
+        GL_FALSE,
+        VERTEX_COMPONENTS * sizeof(GLfloat),
+        (void*)0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, INSTANCE_VBO);
+
+    // glBufferStorage and base instance drawing are both GL 4.4 core
+    if (persistentMapping && GLAD_GL_VERSION_4_4) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GLsizeiptr ringSize = (GLsizeiptr)INSTANCE_RING_REGIONS * totalParticles * sizeof(particle_instance);
+
+        glBufferStorage(GL_ARRAY_BUFFER, ringSize, nullptr, flags);
+        mappedInstances = (particle_instance*)glMapBufferRange(GL_ARRAY_BUFFER, 0, ringSize, flags);
+
+        // Multi-draw commands for batched systems, GL 4.3 core
+        glGenBuffers(1, &INDIRECT_BUFFER);
+    }
+
+    if (!mappedInstances) {
+        instances = std::make_unique<std::vector<particle_instance>>();
+        instances->resize(totalParticles);
+        glBufferData(GL_ARRAY_BUFFER, totalParticles * sizeof(particle_instance), nullptr, GL_STREAM_DRAW);
+    }
+
+    glEnableVertexAttribArray(positionAttribIndex);
+    glVertexAttribPointer(positionAttribIndex,
+        INSTANCE_POSITION_COMPONENTS,
+        GL_FLOAT,
+        GL_FALSE,
+        sizeof(particle_instance),
+        (void*)offsetof(particle_instance, position));
+    glVertexAttribDivisor(positionAttribIndex, 1);
+
+    glEnableVertexAttribArray(scaleAttribIndex);
+    glVertexAttribPointer(scaleAttribIndex,
+        INSTANCE_VEC2_COMPONENTS,
+        GL_FLOAT,
+        GL_FALSE,
+        sizeof(particle_instance),
+        (void*)offsetof(particle_instance, scale));
+    glVertexAttribDivisor(scaleAttribIndex, 1);
+
+    glEnableVertexAttribArray(colorAttribIndex);
+    glVertexAttribPointer(colorAttribIndex,
+        COLOR_COMPONENTS,
+        GL_UNSIGNED_BYTE,
+        GL_TRUE,
+        sizeof(particle_instance),
+        (void*)offsetof(particle_instance, color));
+    glVertexAttribDivisor(colorAttribIndex, 1);
+
+    glEnableVertexAttribArray(frameAttribIndex);
+    glVertexAttribIPointer(frameAttribIndex,
+        1,
+        GL_UNSIGNED_INT,
+        sizeof(particle_instance),
+        (void*)offsetof(particle_instance, frame));
+    glVertexAttribDivisor(frameAttribIndex, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    particlesShader = std::make_unique<Shader>("Shaders/vertex.glsl", "Shaders/fragment.glsl");
+    particlesShader->BindUniformBlock("Camera", CAMERA_UBO_BINDING);
+    particlesShader->SetProgramInt("atlas", ATLAS_TEXTURE_UNIT);
+    camera.Init();
+
+    std::vector<uint32_t> atlas;
+    int atlasWidth, atlasHeight;
+    BuildDefaultAtlas(atlas, atlasWidth, atlasHeight);
+    SetAtlas(atlas.data(), atlasWidth, atlasHeight, DEFAULT_ATLAS_COLUMNS, DEFAULT_ATLAS_ROWS);
+
+    gpuTimer.Init();
+    
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+
+	std::cout << "Particle renderer initialized" << std::endl;
+}
+
+void particle_renderer::SetAtlas(const uint32_t* pixels, int width, int height, int columns, int rows)
+{
+    if (!ATLAS_TEXTURE) {
+        glGenTextures(1, &ATLAS_TEXTURE);
+    }
+    atlasColumns = columns;
+    atlasRows    = rows;
+    particlesShader->SetProgramInt2("atlasGrid", columns, rows);
+
+    // No mipmaps, sprites are drawn near their own size. The vertex shader
+    // keeps the coordinates half a texel inside each cell, so linear
+    // filtering doesn't pick up the neighbors
+    glBindTexture(GL_TEXTURE_2D, ATLAS_TEXTURE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void particle_renderer::UploadToGPU(const particle_system& particleSystem, float alpha)
+{
+    int count = particleSystem.lastActiveParticle + 1;
+    if (count > totalParticles) {
+        count = totalParticles;
+    }
+
+    particle_instance* dst = BeginUpload();
+    WriteInstances(particleSystem, dst, count, alpha);
+    AddDraw(0, count);
+    EndUpload();
+}
+
+particle_instance* particle_renderer::BeginUpload()
+{
+    drawCommands.clear();
+    instanceCount = 0;
+
+    if (mappedInstances) {
+        ringRegion = (ringRegion + 1) % INSTANCE_RING_REGIONS;
+        WaitForRegion(ringRegion);
+        return mappedInstances + ringRegion * totalParticles;
+    }
+    return instances->data();
+}
+
+void particle_renderer::AddDraw(int first, int count)
+{
+    if (count <= 0) {
+        return;
+    }
+
+    draw_elements_command command;
+    command.count         = INDICES_PER_QUAD;
+    command.instanceCount = count;
+    command.firstIndex    = 0;
+    command.baseVertex    = 0;
+    command.baseInstance  = first;
+    drawCommands.push_back(command);
+
+    int end = first + count;
+    instanceCount = end > instanceCount ? end : instanceCount;
+}
+
+void particle_renderer::EndUpload()
+{
+    PROFILE_SCOPE("End upload");
+    gpuTimer.Begin(GPU_TIMER_UPLOAD);
+
+    if (mappedInstances) {
+        // Instances sit in the current ring region
+        for (draw_elements_command& command : drawCommands) {
+            command.baseInstance += ringRegion * totalParticles;
+        }
+        if (drawCommands.size() > 1) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, INDIRECT_BUFFER);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, drawCommands.size() * sizeof(draw_elements_command), drawCommands.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+    }
+    else if (instanceCount > 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, INSTANCE_VBO);
+        // Orphan the old storage instead of waiting for the GPU to release it
+        glBufferData(GL_ARRAY_BUFFER, totalParticles * sizeof(particle_instance), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER,
+            0,
+            instanceCount * sizeof(particle_instance),
+            instances->data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    gpuTimer.End(GPU_TIMER_UPLOAD);
+}
+
+void particle_renderer::WaitForRegion(int region)
+{
+    GLsync fence = regionFences[region];
+    if (!fence) {
+        return;
+    }
+
+    PROFILE_SCOPE("Wait for GPU");
+    GLenum result;
+    do {
+        result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    } while (result == GL_TIMEOUT_EXPIRED);
+
+    glDeleteSync(fence);
+    regionFences[region] = nullptr;
+}
+
+void particle_renderer::Render()
+{
+    PROFILE_SCOPE("Draw");
+    particlesShader->Bind();
+    camera.Bind(window::s_Instance->windowProperties.width, window::s_Instance->windowProperties.height);
+
+    gpuTimer.Begin(GPU_TIMER_DRAW);
+
+    glBlendFunc(GL_SRC_ALPHA, blendMode == BLEND_ALPHA ? GL_ONE_MINUS_SRC_ALPHA : GL_ONE);
+
+    glActiveTexture(GL_TEXTURE0 + ATLAS_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, ATLAS_TEXTURE);
+
+    // One draw whatever the number of systems batched into the buffer
+    glBindVertexArray(VAO);
+    if (!drawCommands.empty()) {
+        if (!mappedInstances) {
+            glDrawElementsInstanced(GL_TRIANGLES, INDICES_PER_QUAD, GL_UNSIGNED_INT, 0, instanceCount);
+        }
+        else if (drawCommands.size() == 1) {
+            const draw_elements_command& command = drawCommands[0];
+            glDrawElementsInstancedBaseInstance(GL_TRIANGLES, INDICES_PER_QUAD, GL_UNSIGNED_INT, 0, command.instanceCount, command.baseInstance);
+        }
+        else {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, INDIRECT_BUFFER);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, (GLsizei)drawCommands.size(), 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+    }
+    glBindVertexArray(0);
+
+    gpuTimer.End(GPU_TIMER_DRAW);
+    gpuTimer.EndFrame();
+
+    // The region can be written again once the GPU is past this point
+    if (mappedInstances) {
+        regionFences[ringRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+
+render_stats particle_renderer::GetStats()
+{
+    render_stats stats;
+    stats.instances    = instanceCount;
+    stats.drawCommands = (int)drawCommands.size();
+    stats.gpuUploadMilliseconds = gpuTimer.GetMilliseconds(GPU_TIMER_UPLOAD);
+    stats.gpuDrawMilliseconds   = gpuTimer.GetMilliseconds(GPU_TIMER_DRAW);
+    return stats;
+}
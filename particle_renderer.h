@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include "Shader.h"
+#include "particle_instance.h"
+#include "gpu_timer.h"
+#include "camera.h"
+
+struct particle_system;
+
+// Regions in the persistent instance ring. The CPU fills one while the GPU
+// may still be reading the other two.
+#define INSTANCE_RING_REGIONS 3
+
+// Texture unit the sprite atlas is bound to, see SetAtlas
+#define ATLAS_TEXTURE_UNIT 0
+
+// Layout glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER
+struct draw_elements_command
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// Shared by everything in the draw. Alpha blending only looks right when
+// the particles arrive back to front, see draw_sort_settings
+enum blend_mode
+{
+	BLEND_ADDITIVE,
+	BLEND_ALPHA
+};
+
+// What the last frame cost. GPU times come back a couple of frames late and
+// stay 0 where timer queries aren't available. With the persistent ring the
+// instances are plain CPU stores, so the upload time only covers the GL
+// commands issued for them (the indirect draw buffer).
+struct render_stats
+{
+	int instances;
+	int drawCommands;
+	float gpuUploadMilliseconds;
+	float gpuDrawMilliseconds;
+};
+
+// Draws the state owned by a particle_system. The simulation itself never
+// touches GL, so this is the only piece that needs a context.
+struct particle_renderer
+{
+	// Streams through a persistently mapped ring when the context has GL 4.4
+	// and persistentMapping is set, otherwise falls back to glBufferSubData
+	void Init(int maxParticles, bool persistentMapping = true);
+	// alpha places the instances between the last two updates, 1 draws the
+	// latest state as is
+	void UploadToGPU(const particle_system& particleSystem, float alpha = 1.0f);
+	void Render();
+
+	// Batched upload for several systems sharing the instance buffer:
+	// BeginUpload, WriteInstances into the returned array, AddDraw each
+	// written range, then EndUpload. Render issues a single draw for all of
+	// them. Without persistent mapping the ranges must be packed from 0,
+	// since a GL 4.1 instanced draw has no base instance
+	particle_instance* BeginUpload();
+	void AddDraw(int first, int count);
+	void EndUpload();
+
+	// Replaces the sprite atlas, RGBA8 rows top first, split into columns x
+	// rows cells. Every emitter samples the same texture, so the draw stays
+	// single however many different sprites are in use. Init loads the
+	// built-in atlas
+	void SetAtlas(const uint32_t* pixels, int width, int height, int columns, int rows);
+
+	inline bool IsPersistentMapped() { return(mappedInstances != nullptr); };
+	render_stats GetStats();
+
+	int totalParticles = 0;
+	int instanceCount  = 0;
+	blend_mode blendMode = BLEND_ADDITIVE;
+
+	// One command per range added since BeginUpload
+	std::vector<draw_elements_command> drawCommands;
+	GLuint INDIRECT_BUFFER = 0;
+
+	// Persistent ring
+	int ringRegion = 0;
+	particle_instance* mappedInstances = nullptr;
+	GLsync regionFences[INSTANCE_RING_REGIONS] = {};
+
+	// Staging for the glBufferSubData fallback
+	std::unique_ptr<std::vector<particle_instance>> instances;
+
+	gpu_timer gpuTimer;
+	camera_buffer camera;
+
+	GLuint ATLAS_TEXTURE = 0;
+	int atlasColumns = 1;
+	int atlasRows    = 1;
+
+	GLuint VAO, VBO, EBO, INSTANCE_VBO;
+	std::unique_ptr<Shader> particlesShader;
+
+private:
+	void WaitForRegion(int region);
+};
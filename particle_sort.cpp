@@ -0,0 +1,140 @@
+#include "particle_sort.h"
+
+#include "profiler.h"
+
+#include <algorithm>
+
+// Histograms are per RADIX_CHUNK_SIZE chunk, so the serial path walks the
+// same chunks
+static void ForEachRange(job_system* jobSystem, int count, const std::function<void(int, int)>& fn)
+{
+    if (jobSystem) {
+        jobSystem->ParallelFor(count, RADIX_CHUNK_SIZE, fn);
+    }
+    else {
+        for (int begin = 0; begin < count; begin += RADIX_CHUNK_SIZE) {
+            fn(begin, begin + RADIX_CHUNK_SIZE < count ? begin + RADIX_CHUNK_SIZE : count);
+        }
+    }
+}
+
+void radix_sorter::Sort(uint32_t* keys, int* values, int count, job_system* jobSystem)
+{
+    PROFILE_SCOPE("Radix sort");
+    if (count < 2) {
+        return;
+    }
+
+    int chunks = (count + RADIX_CHUNK_SIZE - 1) / RADIX_CHUNK_SIZE;
+    keyScratch.resize(count);
+    valueScratch.resize(count);
+    histograms.resize((size_t)chunks * RADIX_BUCKETS);
+
+    uint32_t* srcKeys = keys;
+    int* srcValues    = values;
+    uint32_t* dstKeys = keyScratch.data();
+    int* dstValues    = valueScratch.data();
+
+    for (int shift = 0; shift < 32; shift += RADIX_BITS) {
+        ForEachRange(jobSystem, count, [&](int begin, int end) {
+            int* histogram = histograms.data() + (size_t)(begin / RADIX_CHUNK_SIZE) * RADIX_BUCKETS;
+            for (int b = 0; b < RADIX_BUCKETS; b++) {
+                histogram[b] = 0;
+            }
+            for (int i = begin; i < end; i++) {
+                histogram[(srcKeys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+            }
+        });
+
+        // Exclusive prefix sum, digit major and chunk minor, turns the
+        // counts into every chunk's first slot per digit
+        int sum = 0;
+        bool skip = false;
+        for (int b = 0; b < RADIX_BUCKETS; b++) {
+            int digitTotal = 0;
+            for (int c = 0; c < chunks; c++) {
+                int& slot = histograms[(size_t)c * RADIX_BUCKETS + b];
+                int n = slot;
+                slot = sum + digitTotal;
+                digitTotal += n;
+            }
+            if (digitTotal == count) {
+                skip = true;
+                break;
+            }
+            sum += digitTotal;
+        }
+        if (skip) {
+            continue;
+        }
+
+        ForEachRange(jobSystem, count, [&](int begin, int end) {
+            int* cursor = histograms.data() + (size_t)(begin / RADIX_CHUNK_SIZE) * RADIX_BUCKETS;
+            for (int i = begin; i < end; i++) {
+                int slot = cursor[(srcKeys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+                dstKeys[slot]   = srcKeys[i];
+                dstValues[slot] = srcValues[i];
+            }
+        });
+
+        std::swap(srcKeys, dstKeys);
+        std::swap(srcValues, dstValues);
+    }
+
+    // An odd number of passes leaves the result in the scratch arrays
+    if (srcKeys != keys) {
+        ForEachRange(jobSystem, count, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                keys[i]   = srcKeys[i];
+                values[i] = srcValues[i];
+            }
+        });
+    }
+}
+
+bool radix_sorter::SortNearlySorted(uint32_t* keys, int* values, int count, long long maxMoves, long long& moves)
+{
+    PROFILE_SCOPE("Insertion sort");
+    moves = 0;
+    for (int i = 1; i < count; i++) {
+        uint32_t key = keys[i];
+        if (keys[i - 1] <= key) {
+            continue;
+        }
+
+        int value = values[i];
+        int j = i;
+        while (j > 0 && keys[j - 1] > key) {
+            keys[j]   = keys[j - 1];
+            values[j] = values[j - 1];
+            j--;
+        }
+        keys[j]   = key;
+        values[j] = value;
+
+        moves += i - j;
+        if (moves > maxMoves) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void radix_sorter::Merge(uint32_t* keys, int* values, int middle, int count)
+{
+    PROFILE_SCOPE("Merge");
+    keyScratch.resize(count);
+    valueScratch.resize(count);
+
+    int a = 0;
+    int b = middle;
+    for (int out = 0; out < count; out++) {
+        bool first = b == count || (a < middle && keys[a] <= keys[b]);
+        int from = first ? a++ : b++;
+        keyScratch[out]   = keys[from];
+        valueScratch[out] = values[from];
+    }
+
+    std::copy(keyScratch.begin(), keyScratch.begin() + count, keys);
+    std::copy(valueScratch.begin(), valueScratch.begin() + count, values);
+}
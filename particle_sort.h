@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "job_system.h"
+
+// Keys per job in the radix passes
+#define RADIX_CHUNK_SIZE 16384
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+// Maps a float to a key whose unsigned order is the float order, negative
+// numbers included
+inline uint32_t SortableKey(float value)
+{
+	uint32_t bits;
+	static_assert(sizeof(bits) == sizeof(value), "float must be 32 bits");
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t mask = (bits & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u;
+	return bits ^ mask;
+}
+
+// Stable sort of values by keys. Both arrays are sorted in place
+struct radix_sorter
+{
+	// LSD radix sort, RADIX_BITS per pass. A pass is skipped when every key
+	// has the same digit, so keys spanning a small range take fewer passes.
+	// Each pass counts digits per chunk, then every chunk scatters to its
+	// own offsets, so the result doesn't depend on the thread count
+	void Sort(uint32_t* keys, int* values, int count, job_system* jobSystem = nullptr);
+
+	// Insertion sort, for input that is nearly in order. Gives up once it
+	// has moved more than maxMoves elements, leaving a valid permutation
+	// that isn't sorted yet. Returns whether it finished, moves counts
+	// the elements it shifted either way
+	static bool SortNearlySorted(uint32_t* keys, int* values, int count, long long maxMoves, long long& moves);
+
+	// Merges the sorted runs [0, middle) and [middle, count), the first run
+	// winning ties
+	void Merge(uint32_t* keys, int* values, int middle, int count);
+
+	std::vector<uint32_t> keyScratch;
+	std::vector<int> valueScratch;
+	std::vector<int> histograms; // RADIX_BUCKETS per chunk
+};
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <utility>
+
+#define PARTICLE_STORAGE_ALIGNMENT 64
+
+// Position of Column in Columns, resolved at compile time
+template <typename Column, typename... Columns>
+struct column_index;
+
+template <typename Column, typename... Rest>
+struct column_index<Column, Column, Rest...>
+{
+	static constexpr int value = 0;
+};
+
+template <typename Column, typename First, typename... Rest>
+struct column_index<Column, First, Rest...>
+{
+	static constexpr int value = 1 + column_index<Column, Rest...>::value;
+};
+
+// Bytes one particle takes in the given columns. A column listed twice
+// counts twice, e.g. once read and once written
+template <typename... Columns>
+constexpr int ColumnBytes()
+{
+	return (int)(0 + ... + sizeof(typename Columns::type));
+}
+
+// All columns of a particle set in one 64-byte aligned allocation. Each
+// column is a tag type naming its element type, e.g.
+//     struct position_column { typedef glm::vec2 type; };
+//
+// BlockWidth 0 is plain SoA: every column is one contiguous run over the
+// whole capacity, starting on its own cache line. Any other BlockWidth is
+// AoSoA: particles are grouped in blocks of BlockWidth, and each block holds
+// BlockWidth consecutive elements of every column.
+template <int BlockWidth, typename... Columns>
+struct particle_storage
+{
+	static constexpr int ColumnCount = sizeof...(Columns);
+	// One particle across every column
+	static constexpr int ParticleBytes = ColumnBytes<Columns...>();
+
+	particle_storage(int capacity = 0) { Allocate(capacity); }
+
+	particle_storage(const particle_storage&) = delete;
+	particle_storage& operator=(const particle_storage&) = delete;
+
+	// Drops the old contents, the new memory is zeroed
+	void Allocate(int newCapacity)
+	{
+		const size_t sizes[ColumnCount] = { sizeof(typename Columns::type)... };
+
+		capacity = newCapacity;
+		size_t offset = 0;
+
+		if (BlockWidth == 0) {
+			for (int k = 0; k < ColumnCount; k++) {
+				offsets[k] = offset;
+				offset += AlignUp(sizes[k] * capacity);
+			}
+			blockBytes = 0;
+		}
+		else {
+			for (int k = 0; k < ColumnCount; k++) {
+				offsets[k] = offset;
+				offset += sizes[k] * (BlockWidth > 0 ? BlockWidth : 1);
+			}
+			blockBytes = AlignUp(offset);
+			offset = blockBytes * GetBlockCount();
+		}
+
+		bytes = offset;
+		memory.reset((unsigned char*)::operator new(bytes > 0 ? bytes : PARTICLE_STORAGE_ALIGNMENT,
+			std::align_val_t(PARTICLE_STORAGE_ALIGNMENT)));
+		std::memset(memory.get(), 0, bytes);
+	}
+
+	inline int GetBlockCount() const
+	{
+		return BlockWidth > 0 ? (capacity + BlockWidth - 1) / BlockWidth : 1;
+	}
+
+	// Whole column, SoA only
+	template <typename Column>
+	typename Column::type* Data()
+	{
+		static_assert(BlockWidth == 0, "Data() needs the SoA layout, use Block() or Get()");
+		return (typename Column::type*)(memory.get() + offsets[column_index<Column, Columns...>::value]);
+	}
+
+	// Lane 0 of Column inside a block, AoSoA only
+	template <typename Column>
+	typename Column::type* Block(int block)
+	{
+		static_assert(BlockWidth > 0, "Block() needs the AoSoA layout, use Data() or Get()");
+		return (typename Column::type*)(memory.get() + block * blockBytes + offsets[column_index<Column, Columns...>::value]);
+	}
+
+	template <typename Column>
+	typename Column::type& Get(int index)
+	{
+		if constexpr (BlockWidth == 0) {
+			return Data<Column>()[index];
+		}
+		else {
+			return Block<Column>(index / BlockWidth)[index % BlockWidth];
+		}
+	}
+
+	void Swap(particle_storage& other)
+	{
+		std::swap(memory, other.memory);
+		std::swap(offsets, other.offsets);
+		std::swap(capacity, other.capacity);
+		std::swap(bytes, other.bytes);
+		std::swap(blockBytes, other.blockBytes);
+	}
+
+	int capacity = 0;
+	size_t bytes = 0;
+	size_t blockBytes = 0;
+
+private:
+	struct aligned_delete
+	{
+		void operator()(unsigned char* p) const
+		{
+			::operator delete(p, std::align_val_t(PARTICLE_STORAGE_ALIGNMENT));
+		}
+	};
+
+	static constexpr size_t AlignUp(size_t size)
+	{
+		return (size + PARTICLE_STORAGE_ALIGNMENT - 1) & ~(size_t)(PARTICLE_STORAGE_ALIGNMENT - 1);
+	}
+
+	std::unique_ptr<unsigned char, aligned_delete> memory;
+	size_t offsets[ColumnCount] = {};
+};
@@ -1,120 +1,18 @@
 #include "particle_system.h"
+#include "profiler.h"
 
-#include "window.h"
-#include <random>
-
-#define VERTEX_COMPONENTS 2
-#define COLOR_COMPONENTS  4
-#define VERTICES_PER_QUAD 4
-#define INDICES_PER_QUAD  6
-
-std::default_random_engine generator;
-std::uniform_real_distribution<double> distribution(-10.0, 10.0);
+// Random values are drawn in batches of this many per stream
+#define SPAWN_RANDOM_BATCH 256
 
 particle_system::particle_system(int maxParticles)
-	: totalParticles(maxParticles)
+	: totalParticles(maxParticles), particleData()
 {    
-	position    = std::make_unique<std::vector<glm::vec2>>();
-	speed       = std::make_unique<std::vector<glm::vec2>>();
-	colorBegin  = std::make_unique<std::vector<glm::vec4>>();
-	colorEnd    = std::make_unique<std::vector<glm::vec4>>();
-	color       = std::make_unique<std::vector<glm::vec4>>();
-    scaleBegin  = std::make_unique<std::vector<glm::vec3>>();
-    scaleEnd    = std::make_unique<std::vector<glm::vec3>>();
-    scale       = std::make_unique<std::vector<glm::vec3>>();
-	currentLife = std::make_unique<std::vector<float>>();
-    totalLife   = std::make_unique<std::vector<float>>();
-    models      = std::make_unique<std::vector<glm::mat4>>();
-
-	position    ->resize(totalParticles);
-	speed       ->resize(totalParticles);
-	colorBegin  ->resize(totalParticles);
-	colorEnd    ->resize(totalParticles);
-	color       ->resize(totalParticles);
-    scaleBegin  ->resize(totalParticles);
-    scaleEnd    ->resize(totalParticles);
-    scale       ->resize(totalParticles);
-    currentLife ->resize(totalParticles);
-	totalLife   ->resize(totalParticles);
-    models      ->resize(totalParticles);
-}
-
-void particle_system::Init()
-{
-    int vertexAttribIndex = 0;
-    int colorAttribIndex  = 1;
-
-    float pVerts[] = {
-        0.5f,  0.5f,
-        0.5f, -0.5f,
-       -0.5f, -0.5f,
-       -0.5f,  0.5f,
-    };
-
-    unsigned int pIndices[] = {
-        0, 1, 3,
-        1, 2, 3
-    };
-
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-	glGenBuffers(1, &EBO);
-    glGenBuffers(1, &MODELS_VBO);
-    glGenBuffers(1, &COLORS_VBO);
+    storage.Allocate(totalParticles);
+    BindColumns();
 
-	glBindVertexArray(VAO);
-    
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(pIndices), pIndices, GL_STATIC_DRAW);
-    
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(pVerts), pVerts, GL_STATIC_DRAW);
-
-    glEnableVertexAttribArray(vertexAttribIndex);
-    glVertexAttribPointer(vertexAttribIndex,
-        VERTEX_COMPONENTS,
-        GL_FLOAT,
-        GL_FALSE,
-        VERTEX_COMPONENTS * sizeof(GLfloat),
-        (void*)0);
-
-    glBindBuffer(GL_ARRAY_BUFFER, COLORS_VBO);
-    glBufferData(GL_ARRAY_BUFFER,  totalParticles * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
-    glEnableVertexAttribArray(colorAttribIndex);
-    glVertexAttribPointer(colorAttribIndex,
-        COLOR_COMPONENTS,
-        GL_FLOAT,
-        GL_FALSE,
-        COLOR_COMPONENTS * sizeof(GLfloat),
-        (void*)0);
-    glVertexAttribDivisor(colorAttribIndex, 1);
-
-    glBindBuffer(GL_ARRAY_BUFFER, MODELS_VBO);
-    glBufferData(GL_ARRAY_BUFFER, totalParticles * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)0);
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4)));
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(2 * sizeof(glm::vec4)));
-    glEnableVertexAttribArray(5);
-    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(3 * sizeof(glm::vec4)));
-
-    glVertexAttribDivisor(2, 1);
-    glVertexAttribDivisor(3, 1);
-    glVertexAttribDivisor(4, 1);
-    glVertexAttribDivisor(5, 1);
-
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-    particlesShader = std::make_unique<Shader>("Shaders/vertex.glsl", "Shaders/fragment.glsl");
-    
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-
-	std::cout << "Particle system initialized" << std::endl;
+    SetSimdLevel(DetectSimdLevel());
+    RefreshFeatures();
+    BakeLifetime();
 }
 
 void particle_system::Emit()
@@ -123,82 +21,687 @@ void particle_system::Emit()
         CreateParticle(particleData);
         std::cout << "Particle @ index " << lastActiveParticle << " created" << std::endl;
     }
+    if (!emitting) {
+        msElapsed = 0;
+    }
     emitting = true;
 }
 
 void particle_system::CreateParticle(const particle_data& data)
 {
+    RefreshFeatures();
+
     int firstInactivePIndex = lastActiveParticle + 1;
-    (*position)[firstInactivePIndex]    = data.position;
-    (*speed)[firstInactivePIndex] = 
-        glm::vec2(distribution(generator) * data.speed.x, distribution(generator) * data.speed.y);
-    (*colorBegin)[firstInactivePIndex]  = data.colorBegin;
-    (*colorEnd)[firstInactivePIndex]    = data.colorEnd;
-    (*scaleBegin)[firstInactivePIndex]  = glm::vec3(data.scaleBegin, 0.0f);
-    (*scaleEnd)[firstInactivePIndex]    = glm::vec3(data.scaleEnd, 0.0f);
-    (*currentLife)[firstInactivePIndex] = data.totalLife;
-    (*totalLife)[firstInactivePIndex]   = data.totalLife;
-
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(data.position, 0.0f));
-    model = glm::scale(model, glm::vec3(data.scaleEnd, 0.0f));
-
-    (*models)[firstInactivePIndex] = model;
+    position[firstInactivePIndex]    = data.position;
+    prevPosition[firstInactivePIndex] = data.position;
+    speed[firstInactivePIndex] = 
+        glm::vec2(random.Uniform(RANDOM_DIRECTION_X, spawnSerial, -10.0f, 10.0f) * data.speed.x,
+                  random.Uniform(RANDOM_DIRECTION_Y, spawnSerial, -10.0f, 10.0f) * data.speed.y);
+    float directionZ = random.Uniform(RANDOM_DIRECTION_Z, spawnSerial, -10.0f, 10.0f);
+    spawnSerial++;
+    colorBegin[firstInactivePIndex]  = data.colorBegin;
+    colorEnd[firstInactivePIndex]    = data.colorEnd;
+    color[firstInactivePIndex]       = data.colorBegin;
+    scaleBegin[firstInactivePIndex]  = data.scaleBegin;
+    scaleEnd[firstInactivePIndex]    = data.scaleEnd;
+    scale[firstInactivePIndex]       = data.scaleBegin;
+    currentLife[firstInactivePIndex] = data.totalLife;
+    totalLife[firstInactivePIndex]   = data.totalLife;
+    inverseLife[firstInactivePIndex] = data.totalLife > 0.0f ? 1.0f / data.totalLife : 0.0f;
+    age[firstInactivePIndex]         = 0.0f;
+    if (space == SPACE_3D) {
+        positionZ[firstInactivePIndex]     = data.positionZ;
+        prevPositionZ[firstInactivePIndex] = data.positionZ;
+        speedZ[firstInactivePIndex]        = directionZ * data.speedZ;
+    }
+    if (updateFeatures & UPDATE_LUT) {
+        color[firstInactivePIndex] = lut.color[0];
+        scale[firstInactivePIndex] = lut.scale[0];
+    }
 
     lastActiveParticle++;
+    if (drawSort.key != SORT_NONE) {
+        unsortedCount++;
+    }
 }
 
 void particle_system::Update(timestep ts)
 {
+    PROFILE_SCOPE("Particle update");
     float delta = ts.GetSeconds();
-    msElapsed += ts.GetMilliseconds();
-
-    // Particle state update
-    for (int i = 0; i <= lastActiveParticle; i++) {
-        float remainingLife = (*currentLife)[i];
-        if (remainingLife <= 0.0f) {
-            Destroy(i);
-        }
 
-        (*currentLife)[i] -= delta;
-        (*position)[i]    += (*speed)[i] * delta;
+    RefreshFeatures();
+    emissionStats = emission_stats();
 
-        // Lerp begin & end colors based on remaining life
-        (*color)[i] = glm::mix((*colorEnd)[i], (*colorBegin)[i], (*currentLife)[i] / (*totalLife)[i]);
-        (*scale)[i] = glm::mix((*scaleEnd)[i], (*scaleBegin)[i], (*currentLife)[i] / (*totalLife)[i]);
+    // Over a lowered cap the surplus goes now rather than when it dies
+    if (budget.decimate) {
+        DecimateParticles(budget.particleCap);
+    }
 
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3((*position)[i], 0.0f));
-        model = glm::scale(model, (*scale)[i]);
+    // Particle death
+    CompactParticles();
+
+    // Particle state update. The affectors run on the chunk right before
+    // it is integrated, while it is still in cache
+    {
+        PROFILE_SCOPE("Integrate");
+        particle_columns columns = GetColumns();
+        int stale = staleCount;
+        bool depth = space == SPACE_3D;
+        ForEachChunk(lastActiveParticle + 1, [&](int begin, int end) {
+            for (const particle_affector& affector : affectors) {
+                if (affector.enabled) {
+                    affectorKernels[affector.type](columns, begin, end, affector, delta);
+                }
+            }
+            if (depth) {
+                IntegrateDepth(columns, begin, end, delta);
+            }
+            if (begin < stale) {
+                int split = end < stale ? end : stale;
+                staleKernel(columns, begin, split, delta);
+                begin = split;
+            }
+            if (begin < end) {
+                updateKernel(columns, begin, end, delta);
+            }
+        });
+    }
 
-        (*models)[i] = model;
+    // The grid is 2D, so 3D emitters don't collide
+    if (collision.enabled && space == SPACE_2D) {
+        ResolveCollisions();
     }
 
     //printf("State updated \n");
 
     // Timed particle emission
-    if (emitting) {
-        if (lastActiveParticle + 1 < totalParticles) {
-            if (msElapsed >= ((particleData.emissionFrequency * 1000) / particleData.emitQuantity) && looping) {
+    if (emitting && looping) {
+        float oldestAge, ageStep;
+        int owed = AccrueEmission(ts, oldestAge, ageStep);
+
+        // The particles left are spread over the same stretch of time, so
+        // a throttled stream thins out instead of bunching up
+        int due = owed;
+        if (budget.emitScale < 1.0f && owed > 0) {
+            emitCarry += owed * (double)budget.emitScale;
+            due = (int)emitCarry;
+            emitCarry -= due;
+            ageStep = due > 0 ? ageStep * owed / due : ageStep;
+        }
+
+        int limit     = budget.particleCap < totalParticles ? budget.particleCap : totalParticles;
+        int available = limit - (lastActiveParticle + 1);
+        int count     = due < available ? due : available;
+        count = count > 0 ? count : 0;
+        if (count > 0) {
+            SpawnParticles(count, oldestAge, ageStep);
+        }
+
+        emissionStats.owed    = owed;
+        emissionStats.spawned = count;
+        emissionStats.shed    = owed - due;
+        emissionStats.refused = due - count;
+    }
+
+    if (drawSort.key != SORT_NONE) {
+        SortForDrawing();
+    }
+    else {
+        unsortedCount = 0;
+    }
+}
+
+// msElapsed carries the time not yet paid out as particles, so the rate
+// holds whatever the frame rate is. Nothing accrues while the rate is 0,
+// or turning it back on would pay out the whole pause in one frame
+int particle_system::AccrueEmission(timestep ts, float& oldestAge, float& ageStep)
+{
+    if (particleData.emitQuantity <= 0 || particleData.emissionFrequency <= 0.0f) {
+        msElapsed = 0;
+        return 0;
+    }
+
+    msElapsed += ts.GetMilliseconds();
+    double period = (particleData.emissionFrequency * 1000.0) / particleData.emitQuantity;
+
+    // More than fit in the pool would be refused anyway. Clamping before
+    // the cast keeps a stall or a tiny period from overflowing it, and
+    // the time of the dropped particles goes with them
+    double quotient = msElapsed / period;
+    int owed;
+    if (quotient > (double)totalParticles) {
+        owed = totalParticles;
+        msElapsed = fmod(msElapsed, period);
+    }
+    else {
+        owed = (int)quotient;
+        msElapsed -= owed * period;
+    }
+
+    // Particle j came due (msElapsed + (owed - 1 - j) * period) ms ago
+    ageStep   = (float)(period / 1000.0);
+    oldestAge = (float)((msElapsed + (owed - 1) * period) / 1000.0);
+    return owed;
+}
+
+// Particle n of the emitter's life draws value n of each stream, so the
+// attributes don't depend on how the spawn is chunked across threads.
+// RandomOptions is fixed per instantiation, so the loops carry no option
+// tests.
+template <int RandomOptions>
+static void DrawSpawnAttributesFor(particle_system& p, int count)
+{
+    p.spawnOrigin.resize(count);
+    p.spawnSpeed.resize(count);
+    p.spawnLife.resize(count);
+
+    const particle_data& data = p.particleData;
+    const random_distributions& r = p.rDistr;
+    const particle_random& random = p.random;
+    uint64_t serial = p.spawnSerial;
+
+    p.ForEachChunk(count, [&](int begin, int end) {
+        float x[SPAWN_RANDOM_BATCH];
+        float y[SPAWN_RANDOM_BATCH];
+
+        for (int batch = begin; batch < end; batch += SPAWN_RANDOM_BATCH) {
+            int n = end - batch < SPAWN_RANDOM_BATCH ? end - batch : SPAWN_RANDOM_BATCH;
+            uint64_t first = serial + batch;
+            glm::vec2* origin = p.spawnOrigin.data() + batch;
+            glm::vec2* speed  = p.spawnSpeed.data() + batch;
+            float* life       = p.spawnLife.data() + batch;
+
+            if (RandomOptions & POSITION) {
+                random.Fill(RANDOM_POSITION_X, first, n, r.posXRange.x, r.posXRange.y, x);
+                random.Fill(RANDOM_POSITION_Y, first, n, r.posYRange.x, r.posYRange.y, y);
+                for (int k = 0; k < n; k++) {
+                    origin[k] = glm::vec2(x[k], y[k]);
+                }
+            }
+            else {
+                for (int k = 0; k < n; k++) {
+                    origin[k] = data.position;
+                }
+            }
 
-                if (!(randomOptions & 0x00)) {
-                    RandomizeParticleAttributes();
+            if (RandomOptions & SPEED) {
+                random.Fill(RANDOM_SPEED_X, first, n, r.speedXRange.x, r.speedXRange.y, x);
+                random.Fill(RANDOM_SPEED_Y, first, n, r.speedYRange.x, r.speedYRange.y, y);
+                for (int k = 0; k < n; k++) {
+                    speed[k] = glm::vec2(x[k], y[k]);
                 }
+            }
+            else {
+                for (int k = 0; k < n; k++) {
+                    speed[k] = data.speed;
+                }
+            }
+
+            // Direction, scaled by the speed above
+            random.Fill(RANDOM_DIRECTION_X, first, n, -10.0f, 10.0f, x);
+            random.Fill(RANDOM_DIRECTION_Y, first, n, -10.0f, 10.0f, y);
+            for (int k = 0; k < n; k++) {
+                speed[k] *= glm::vec2(x[k], y[k]);
+            }
+
+            if (RandomOptions & TOTAL_LIFE) {
+                random.Fill(RANDOM_LIFE, first, n, r.lifeRange.x, r.lifeRange.y, life);
+            }
+            else {
+                for (int k = 0; k < n; k++) {
+                    life[k] = data.totalLife;
+                }
+            }
+        }
+    });
+
+    // The third axis draws from its own streams, so 2D attributes are the
+    // same whichever space the emitter is in
+    if (p.space == SPACE_3D) {
+        p.spawnOriginZ.resize(count);
+        p.spawnSpeedZ.resize(count);
+        p.ForEachChunk(count, [&](int begin, int end) {
+            float z[SPAWN_RANDOM_BATCH];
+
+            for (int batch = begin; batch < end; batch += SPAWN_RANDOM_BATCH) {
+                int n = end - batch < SPAWN_RANDOM_BATCH ? end - batch : SPAWN_RANDOM_BATCH;
+                uint64_t first = serial + batch;
+                float* origin  = p.spawnOriginZ.data() + batch;
+                float* speed   = p.spawnSpeedZ.data() + batch;
+
+                if (RandomOptions & POSITION) {
+                    random.Fill(RANDOM_POSITION_Z, first, n, r.posZRange.x, r.posZRange.y, origin);
+                }
+                else {
+                    for (int k = 0; k < n; k++) {
+                        origin[k] = data.positionZ;
+                    }
+                }
+
+                if (RandomOptions & SPEED) {
+                    random.Fill(RANDOM_SPEED_Z, first, n, r.speedZRange.x, r.speedZRange.y, speed);
+                }
+                else {
+                    for (int k = 0; k < n; k++) {
+                        speed[k] = data.speedZ;
+                    }
+                }
+
+                random.Fill(RANDOM_DIRECTION_Z, first, n, -10.0f, 10.0f, z);
+                for (int k = 0; k < n; k++) {
+                    speed[k] *= z[k];
+                }
+            }
+        });
+    }
+
+    p.spawnSerial += count;
+}
+
+// Indexed by POSITION | SPEED in the low bits and TOTAL_LIFE as bit 2
+static const spawn_attribute_drawer s_SpawnDrawers[] = {
+    DrawSpawnAttributesFor<0>,
+    DrawSpawnAttributesFor<POSITION>,
+    DrawSpawnAttributesFor<SPEED>,
+    DrawSpawnAttributesFor<POSITION | SPEED>,
+    DrawSpawnAttributesFor<TOTAL_LIFE>,
+    DrawSpawnAttributesFor<POSITION | TOTAL_LIFE>,
+    DrawSpawnAttributesFor<SPEED | TOTAL_LIFE>,
+    DrawSpawnAttributesFor<POSITION | SPEED | TOTAL_LIFE>
+};
+
+void particle_system::DrawSpawnAttributes(int count)
+{
+    PROFILE_SCOPE("Spawn attributes");
+    spawnDrawer(*this, count);
+}
+
+void particle_system::SpawnParticles(int count, float oldestAge, float ageStep)
+{
+    int available = totalParticles - (lastActiveParticle + 1);
+    if (count > available) {
+        count = available;
+    }
+    if (count <= 0) {
+        return;
+    }
 
-                CreateParticle(particleData);
-                msElapsed = 0;
-                // std::cout << "Particle @ index " << lastActiveParticle << " created" << std::endl;
+    PROFILE_SCOPE("Spawn");
+    RefreshFeatures();
+    DrawSpawnAttributes(count);
+
+    // Every particle is written as it would look after living for its
+    // sub-frame age, color and scale included
+    const particle_data& data = particleData;
+    bool sampled = (updateFeatures & UPDATE_LUT) != 0;
+    int first = lastActiveParticle + 1;
+    auto spawn = [&](int begin, int end) {
+        for (int j = begin; j < end; j++) {
+            int i     = first + j;
+            float spawnAge = oldestAge - j * ageStep;
+            float life = spawnLife[j] - spawnAge;
+            float t    = life / spawnLife[j];
+
+            position[i]    = spawnOrigin[j] + spawnSpeed[j] * spawnAge;
+            // Interpolation then starts from where the particle was emitted
+            prevPosition[i] = spawnOrigin[j];
+            speed[i]       = spawnSpeed[j];
+            colorBegin[i]  = data.colorBegin;
+            colorEnd[i]    = data.colorEnd;
+            color[i]       = data.colorEnd + (data.colorBegin - data.colorEnd) * t;
+            scaleBegin[i]  = data.scaleBegin;
+            scaleEnd[i]    = data.scaleEnd;
+            scale[i]       = data.scaleEnd + (data.scaleBegin - data.scaleEnd) * t;
+            currentLife[i] = life;
+            totalLife[i]   = spawnLife[j];
+            inverseLife[i] = spawnLife[j] > 0.0f ? 1.0f / spawnLife[j] : 0.0f;
+            age[i]         = 1.0f - life * inverseLife[i];
+            if (sampled) {
+                int entry = LutIndex(age[i]);
+                color[i]  = lut.color[entry];
+                scale[i]  = lut.scale[entry];
             }
         }
-        else {
-            //std::cout << "Limit reached! Cannot add more particles" << std::endl;
+    };
+
+    ForEachChunk(count, spawn);
+
+    if (space == SPACE_3D) {
+        ForEachChunk(count, [&](int begin, int end) {
+            for (int j = begin; j < end; j++) {
+                int i = first + j;
+                float spawnAge = oldestAge - j * ageStep;
+                positionZ[i]     = spawnOriginZ[j] + spawnSpeedZ[j] * spawnAge;
+                prevPositionZ[i] = spawnOriginZ[j];
+                speedZ[i]        = spawnSpeedZ[j];
+            }
+        });
+    }
+
+    lastActiveParticle += count;
+    if (drawSort.key != SORT_NONE) {
+        unsortedCount += count;
+    }
+}
+
+// Stable copy of the survivors of each chunk to that chunk's offset in
+// compactStorage. The write is unconditional and only the cursor depends
+// on the mask, so the loop has no branches. Once the cursor reaches the
+// chunk's last survivor slot the loop stops: a blind write past it would
+// land on the next chunk's first slot, which another thread may own.
+template <typename Column>
+static void ScatterColumn(particle_system& p)
+{
+    const unsigned char* alive = p.aliveMask.data();
+    const typename Column::type* src = p.storage.Data<Column>();
+    typename Column::type* dst = p.compactStorage.Data<Column>();
+
+    p.ForEachChunk(p.lastActiveParticle + 1, [&](int begin, int end) {
+        int chunk = begin / UPDATE_CHUNK_SIZE;
+        int out   = p.chunkOffsets[chunk];
+        int limit = p.chunkOffsets[chunk + 1];
+        for (int i = begin; i < end && out < limit; i++) {
+            dst[out] = src[i];
+            out += alive[i];
         }
+    });
+}
+
+// Particle i goes when (i * surplus) / count steps to a new whole number,
+// which spaces the removals count / surplus apart and keeps the survivors
+// a thinned copy of the whole effect. Particles dying this frame anyway are
+// counted as live, there are few of them
+void particle_system::DecimateParticles(int keep)
+{
+    int count   = lastActiveParticle + 1;
+    int surplus = count - (keep > 0 ? keep : 0);
+    if (surplus <= 0) {
+        return;
     }
 
-    UploadToGPU();
-    Render();
+    PROFILE_SCOPE("Decimate");
+    for (int k = 0; k < surplus; k++) {
+        int i = (int)(((long long)k * count + count / 2) / surplus);
+        currentLife[i] = 0.0f;
+    }
+    emissionStats.decimated = surplus;
 }
 
+void particle_system::CompactParticles()
+{
+    int count = lastActiveParticle + 1;
+    if (count <= 0) {
+        return;
+    }
+
+    PROFILE_SCOPE("Compact");
+    int chunks = (count + UPDATE_CHUNK_SIZE - 1) / UPDATE_CHUNK_SIZE;
+    aliveMask.resize(totalParticles);
+    chunkOffsets.resize(chunks + 1);
+
+    // Mask and per-chunk survivor counts
+    ForEachChunk(count, [&](int begin, int end) {
+        int alive = 0;
+        for (int i = begin; i < end; i++) {
+            unsigned char a = currentLife[i] > 0.0f;
+            aliveMask[i] = a;
+            alive += a;
+        }
+        chunkOffsets[begin / UPDATE_CHUNK_SIZE + 1] = alive;
+    });
+
+    // Exclusive prefix sum over chunks
+    chunkOffsets[0] = 0;
+    for (int c = 0; c < chunks; c++) {
+        chunkOffsets[c + 1] += chunkOffsets[c];
+    }
+
+    int survivors = chunkOffsets[chunks];
+    if (survivors == count) {
+        return;
+    }
+
+    // Survivors keep their order, so the stale particles stay a prefix
+    if (staleCount > 0) {
+        int chunk = staleCount / UPDATE_CHUNK_SIZE;
+        int stale = chunkOffsets[chunk];
+        for (int i = chunk * UPDATE_CHUNK_SIZE; i < staleCount; i++) {
+            stale += aliveMask[i];
+        }
+        staleCount = stale;
+    }
+
+    if (compactStorage.capacity != totalParticles) {
+        compactStorage.Allocate(totalParticles);
+    }
+
+    ScatterColumn<position_column>(*this);
+    ScatterColumn<speed_column>(*this);
+    ScatterColumn<scale_begin_column>(*this);
+    ScatterColumn<scale_end_column>(*this);
+    ScatterColumn<color_begin_column>(*this);
+    ScatterColumn<color_end_column>(*this);
+    ScatterColumn<current_life_column>(*this);
+    ScatterColumn<total_life_column>(*this);
+    ScatterColumn<inverse_life_column>(*this);
+    // IntegrateDepth rewrites prevPositionZ like the kernels do prevPosition
+    if (space == SPACE_3D) {
+        ScatterColumn<position_z_column>(*this);
+        ScatterColumn<speed_z_column>(*this);
+    }
+
+    // The update kernel right after this always rewrites prevPosition, and
+    // color and scale unless it was built without them. LUT kernels also
+    // rewrite age, which nothing else reads
+    auto writes = [](int features) { return features & UPDATE_LUT ? UPDATE_ALL : features; };
+    int rewritten = writes(updateFeatures) & (staleCount > 0 ? writes(staleFeatures) : UPDATE_ALL);
+    if (!(rewritten & UPDATE_COLOR)) {
+        ScatterColumn<color_column>(*this);
+    }
+    if (!(rewritten & UPDATE_SCALE)) {
+        ScatterColumn<scale_column>(*this);
+    }
+
+    storage.Swap(compactStorage);
+    BindColumns();
+
+    lastActiveParticle = survivors - 1;
+}
+
+// Copies the particles to compactStorage in sortOrder
+template <typename Column>
+static void GatherColumn(particle_system& p)
+{
+    const int* order = p.sortOrder.data();
+    const typename Column::type* src = p.storage.Data<Column>();
+    typename Column::type* dst = p.compactStorage.Data<Column>();
+
+    p.ForEachChunk(p.lastActiveParticle + 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            dst[i] = src[order[i]];
+        }
+    });
+}
+
+void particle_system::SortForDrawing()
+{
+    sortStats = draw_sort_stats();
+    int count = lastActiveParticle + 1;
+    if (count < 2) {
+        return;
+    }
+
+    PROFILE_SCOPE("Draw sort");
+    sortKeys.resize(count);
+    sortOrder.resize(count);
+    draw_sort_key key = drawSort.key;
+    bool view = key == SORT_DEPTH && space == SPACE_3D;
+    glm::vec3 eye     = drawSort.viewPosition;
+    glm::vec3 forward = drawSort.viewForward;
+    ForEachChunk(count, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            // Remaining fraction of life, lowest is oldest
+            float value = key == SORT_AGE ? currentLife[i] * inverseLife[i] : position[i].y;
+            if (view) {
+                glm::vec3 d(position[i].x - eye.x, position[i].y - eye.y, positionZ[i] - eye.z);
+                value = -glm::dot(d, forward);
+            }
+            sortKeys[i]  = SortableKey(value);
+            sortOrder[i] = i;
+        }
+    });
+
+    // Particles that died before their first sort leave fewer appended
+    // ones than counted. The difference is only sorted the slower way
+    int tail = unsortedCount < count ? unsortedCount : count;
+    tail = tail > 0 ? tail : 0;
+    int body = count - tail;
+    unsortedCount = 0;
+
+    // The body is in last frame's order, so most frames the insertion sort
+    // finishes in about one pass. A shuffled order costs it a bounded
+    // amount of work before the radix sort takes over from where it stopped
+    long long maxMoves = (long long)(drawSort.coherentMoves * count);
+    if (!radix_sorter::SortNearlySorted(sortKeys.data(), sortOrder.data(), body, maxMoves, sortStats.moves)) {
+        sorter.Sort(sortKeys.data(), sortOrder.data(), count, jobSystem);
+        sortStats.radix = true;
+    }
+    else if (tail > 0) {
+        sorter.Sort(sortKeys.data() + body, sortOrder.data() + body, tail);
+        if (body > 0 && sortKeys[body - 1] > sortKeys[body]) {
+            sorter.Merge(sortKeys.data(), sortOrder.data(), body, count);
+            sortStats.merged = tail;
+        }
+    }
+
+    sortStats.reordered = sortStats.radix || sortStats.moves > 0 || sortStats.merged > 0;
+    for (int i = body; i < count && !sortStats.reordered; i++) {
+        sortStats.reordered = sortOrder[i] != i;
+    }
+    if (!sortStats.reordered) {
+        return;
+    }
+
+    if (compactStorage.capacity != totalParticles) {
+        compactStorage.Allocate(totalParticles);
+    }
+
+    GatherColumn<position_column>(*this);
+    GatherColumn<prev_position_column>(*this);
+    GatherColumn<speed_column>(*this);
+    GatherColumn<color_begin_column>(*this);
+    GatherColumn<color_end_column>(*this);
+    GatherColumn<color_column>(*this);
+    GatherColumn<scale_begin_column>(*this);
+    GatherColumn<scale_end_column>(*this);
+    GatherColumn<scale_column>(*this);
+    GatherColumn<current_life_column>(*this);
+    GatherColumn<total_life_column>(*this);
+    GatherColumn<age_column>(*this);
+    GatherColumn<inverse_life_column>(*this);
+    if (space == SPACE_3D) {
+        GatherColumn<position_z_column>(*this);
+        GatherColumn<prev_position_z_column>(*this);
+        GatherColumn<speed_z_column>(*this);
+    }
+
+    storage.Swap(compactStorage);
+    BindColumns();
+
+    // The grid built this Update still holds the old indices
+    if (collision.enabled && space == SPACE_2D && grid.particleCount > 0 && grid.particleCount <= count) {
+        sortDestination.resize(count);
+        ForEachChunk(count, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                sortDestination[sortOrder[i]] = i;
+            }
+        });
+        grid.Remap(sortDestination.data(), jobSystem);
+    }
+
+    // Stale particles are no longer a prefix. Their kernel covers every
+    // live feature, so it runs on all of them until the settings settle
+    if (staleCount > 0) {
+        staleCount = count;
+    }
+}
+
+void particle_system::ResolveCollisions()
+{
+    int count = lastActiveParticle + 1;
+    if (count < 2) {
+        return;
+    }
+
+    float minDistance = 2.0f * collision.radius;
+    grid.Build(position, count, minDistance, jobSystem);
+
+    PROFILE_SCOPE("Collisions");
+    sortedSpeed.resize(count);
+    ForEachChunk(count, [&](int begin, int end) {
+        for (int s = begin; s < end; s++) {
+            sortedSpeed[s] = speed[grid.sortedIndex[s]];
+        }
+    });
+
+    // Walking the slots in grid order keeps neighboring particles, and so
+    // the buckets they read, close together
+    float response = 0.5f * (1.0f + collision.restitution);
+    ForEachChunk(count, [&](int begin, int end) {
+        for (int s = begin; s < end; s++) {
+            int i       = grid.sortedIndex[s];
+            glm::vec2 p = grid.sortedPosition[s];
+            glm::vec2 v = sortedSpeed[s];
+            glm::vec2 push(0.0f);
+            glm::vec2 impulse(0.0f);
+
+            grid.ForEachNeighbor(p, minDistance, [&](int other) {
+                int j = grid.sortedIndex[other];
+                if (j == i) {
+                    return;
+                }
+
+                glm::vec2 d = p - grid.sortedPosition[other];
+                float distance2 = d.x * d.x + d.y * d.y;
+                glm::vec2 normal;
+                float distance;
+                if (distance2 > 0.0f) {
+                    distance = sqrtf(distance2);
+                    normal   = d / distance;
+                }
+                else {
+                    // Coincident particles split along x by index
+                    distance = 0.0f;
+                    normal   = glm::vec2(i < j ? -1.0f : 1.0f, 0.0f);
+                }
+
+                // Each side of the pair moves half the overlap
+                push += normal * (0.5f * (minDistance - distance));
+
+                float approach = glm::dot(v - sortedSpeed[other], normal);
+                if (approach < 0.0f) {
+                    impulse -= normal * (approach * response);
+                }
+            });
+
+            position[i] = p + push;
+            speed[i]    = v + impulse;
+        }
+    });
+}
+
+void particle_system::ForEachChunk(int count, const std::function<void(int, int)>& fn)
+{
+    if (jobSystem) {
+        jobSystem->ParallelFor(count, UPDATE_CHUNK_SIZE, fn);
+    }
+    else {
+        for (int begin = 0; begin < count; begin += UPDATE_CHUNK_SIZE) {
+            fn(begin, begin + UPDATE_CHUNK_SIZE < count ? begin + UPDATE_CHUNK_SIZE : count);
+        }
+    }
+}
 
 void particle_system::Destroy(const int index)
 {
@@ -218,31 +721,140 @@ void particle_system::Stop()
     emitting = false;
 }
 
-void particle_system::ParticleBurst(unsigned int nrParticles)
+void particle_system::SetSimdLevel(simd_level level)
 {
-    for (int i = 0; i < nrParticles; i++) {
-        CreateParticle(particleData);
+    simdLevel    = level < DetectSimdLevel() ? level : DetectSimdLevel();
+    updateKernel = GetUpdateKernel(simdLevel, updateFeatures);
+    staleKernel  = GetUpdateKernel(simdLevel, staleFeatures);
+    random.fill  = GetRandomFillKernel(simdLevel);
+    for (int type = 0; type < AFFECTOR_TYPE_COUNT; type++) {
+        affectorKernels[type] = GetAffectorKernel(simdLevel, (affector_type)type);
     }
 }
 
+void particle_system::SetSeed(uint64_t seed)
+{
+    random.seed = seed;
+    spawnSerial = 0;
+}
+
+void particle_system::RefreshFeatures()
+{
+    int random = (randomOptions & (POSITION | SPEED)) | ((randomOptions & TOTAL_LIFE) ? 0x04 : 0);
+    spawnDrawer = s_SpawnDrawers[random];
+
+    // A constant attribute is written once at spawn and never lerped
+    int features = 0;
+    if (lifetime.enabled) {
+        features = UPDATE_LUT;
+    }
+    else {
+        if (particleData.colorBegin != particleData.colorEnd) {
+            features |= UPDATE_COLOR;
+        }
+        if (particleData.scaleBegin != particleData.scaleEnd) {
+            features |= UPDATE_SCALE;
+        }
+    }
+    if (features == updateFeatures) {
+        return;
+    }
+
+    // Live particles keep the begin/end they were spawned with. Unless the
+    // new set covers them, they finish their life on a wider kernel. A LUT
+    // in the stale set wins, lerped particles then follow the curves too
+    int live = updateFeatures | (staleCount > 0 ? staleFeatures : 0);
+    if (lastActiveParticle >= 0 && (live & ~features)) {
+        staleFeatures = live;
+        staleCount    = lastActiveParticle + 1;
+    }
+    else {
+        staleFeatures = 0;
+        staleCount    = 0;
+    }
+
+    updateFeatures = features;
+    SetSimdLevel(simdLevel);
+}
+
+particle_columns particle_system::GetColumns()
+{
+    particle_columns columns;
+    columns.position    = position;
+    columns.prevPosition = prevPosition;
+    columns.speed       = speed;
+    columns.colorBegin  = colorBegin;
+    columns.colorEnd    = colorEnd;
+    columns.color       = color;
+    columns.scaleBegin  = scaleBegin;
+    columns.scaleEnd    = scaleEnd;
+    columns.scale       = scale;
+    columns.currentLife = currentLife;
+    columns.totalLife   = totalLife;
+    columns.age         = age;
+    columns.inverseLife = inverseLife;
+    columns.lut         = &lut;
+    columns.positionZ   = positionZ;
+    columns.prevPositionZ = prevPositionZ;
+    columns.speedZ      = speedZ;
+    return columns;
+}
+
+void particle_system::BindColumns()
+{
+    position    = storage.Data<position_column>();
+    prevPosition = storage.Data<prev_position_column>();
+    speed       = storage.Data<speed_column>();
+    colorBegin  = storage.Data<color_begin_column>();
+    colorEnd    = storage.Data<color_end_column>();
+    color       = storage.Data<color_column>();
+    scaleBegin  = storage.Data<scale_begin_column>();
+    scaleEnd    = storage.Data<scale_end_column>();
+    scale       = storage.Data<scale_column>();
+    currentLife = storage.Data<current_life_column>();
+    totalLife   = storage.Data<total_life_column>();
+    age         = storage.Data<age_column>();
+    inverseLife = storage.Data<inverse_life_column>();
+    positionZ   = storage.Data<position_z_column>();
+    prevPositionZ = storage.Data<prev_position_z_column>();
+    speedZ      = storage.Data<speed_z_column>();
+}
+
+void particle_system::BakeLifetime()
+{
+    lut.Bake(lifetime, particleData.scaleBegin, particleData.scaleEnd);
+}
+
+void particle_system::ParticleBurst(unsigned int nrParticles)
+{
+    SpawnParticles((int)nrParticles, 0.0f, 0.0f);
+}
+
 void particle_system::ClearParticles()
 {
     lastActiveParticle = -1;
+    staleCount = 0;
+    unsortedCount = 0;
 }
 
 void particle_system::SwapData(const int a, const int b)
 {
-	std::swap((*position)[a],    (*position)[b]);
-	std::swap((*speed)[a],       (*speed)[b]);
-	std::swap((*colorBegin)[a],  (*colorBegin)[b]);
-	std::swap((*colorEnd)[a],    (*colorEnd)[b]);
-	std::swap((*color)[a],       (*color)[b]);
-    std::swap((*scaleBegin)[a],  (*scaleBegin)[b]);
-    std::swap((*scaleEnd)[a],    (*scaleEnd)[b]);
-    std::swap((*scale)[a],       (*scale)[b]);
-    std::swap((*currentLife)[a], (*currentLife)[b]);
-	std::swap((*totalLife)[a],   (*totalLife)[b]);
-    std::swap((*models)[a],      (*models)[b]);
+	std::swap(position[a],    position[b]);
+	std::swap(prevPosition[a], prevPosition[b]);
+	std::swap(speed[a],       speed[b]);
+	std::swap(colorBegin[a],  colorBegin[b]);
+	std::swap(colorEnd[a],    colorEnd[b]);
+	std::swap(color[a],       color[b]);
+    std::swap(scaleBegin[a],  scaleBegin[b]);
+    std::swap(scaleEnd[a],    scaleEnd[b]);
+    std::swap(scale[a],       scale[b]);
+    std::swap(currentLife[a], currentLife[b]);
+	std::swap(totalLife[a],   totalLife[b]);
+	std::swap(age[a],         age[b]);
+	std::swap(inverseLife[a], inverseLife[b]);
+	std::swap(positionZ[a],   positionZ[b]);
+	std::swap(prevPositionZ[a], prevPositionZ[b]);
+	std::swap(speedZ[a],      speedZ[b]);
 }
 
 void particle_system::SetRandom(const particle_attribute attribute, bool enabled)
@@ -253,31 +865,30 @@ void particle_system::SetRandom(const particle_attribute attribute, bool enabled
     else {
         randomOptions = randomOptions & ~attribute;
     }
+    RefreshFeatures();
 }
 
 void particle_system::RandomizeParticleAttributes()
 {
     if (randomOptions & POSITION) {
-        float wWidth = window::s_Instance->windowProperties.width;
-        float wHeight = window::s_Instance->windowProperties.height;
-
         // TODO: Positions should be based on screen coordinates
-        std::uniform_real_distribution<double> pos_randX(rDistr.posXRange.x, rDistr.posXRange.y);
-        std::uniform_real_distribution<double> pos_randY(rDistr.posYRange.x, rDistr.posYRange.y);
-        particleData.position.x = pos_randX(generator);
-        particleData.position.y = pos_randY(generator);
+        particleData.position.x = random.Uniform(RANDOM_POSITION_X, spawnSerial, rDistr.posXRange.x, rDistr.posXRange.y);
+        particleData.position.y = random.Uniform(RANDOM_POSITION_Y, spawnSerial, rDistr.posYRange.x, rDistr.posYRange.y);
+        if (space == SPACE_3D) {
+            particleData.positionZ = random.Uniform(RANDOM_POSITION_Z, spawnSerial, rDistr.posZRange.x, rDistr.posZRange.y);
+        }
     }
 
     if (randomOptions & SPEED) {
-        std::uniform_real_distribution<double> speed_randX(rDistr.speedXRange.x, rDistr.speedXRange.y);
-        std::uniform_real_distribution<double> speed_randY(rDistr.speedYRange.x, rDistr.speedYRange.y);
-        particleData.speed.x = speed_randX(generator);
-        particleData.speed.y = speed_randY(generator);
+        particleData.speed.x = random.Uniform(RANDOM_SPEED_X, spawnSerial, rDistr.speedXRange.x, rDistr.speedXRange.y);
+        particleData.speed.y = random.Uniform(RANDOM_SPEED_Y, spawnSerial, rDistr.speedYRange.x, rDistr.speedYRange.y);
+        if (space == SPACE_3D) {
+            particleData.speedZ = random.Uniform(RANDOM_SPEED_Z, spawnSerial, rDistr.speedZRange.x, rDistr.speedZRange.y);
+        }
     }
 
     if (randomOptions & TOTAL_LIFE) {
-        std::uniform_real_distribution<double> particleLifeRand(rDistr.lifeRange.x, rDistr.lifeRange.y);
-        particleData.totalLife = particleLifeRand(generator);
+        particleData.totalLife = random.Uniform(RANDOM_LIFE, spawnSerial, rDistr.lifeRange.x, rDistr.lifeRange.y);
     }
 
    /* if (randomOptions & SCALE_BEGIN) {
@@ -296,43 +907,3 @@ void particle_system::RandomizeParticleAttributes()
 
     }*/
 }
-
-void particle_system::UploadToGPU()
-{
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, COLORS_VBO);
-    glBufferSubData(GL_ARRAY_BUFFER,
-        0,
-        color->size() * sizeof(glm::vec4),
-        &(*color)[0]);
-    glBindBuffer(GL_ARRAY_BUFFER, MODELS_VBO);
-    glBufferSubData(GL_ARRAY_BUFFER,
-        0,
-        models->size() * sizeof(glm::mat4),
-        &(*models)[0]);
-}
-
-void particle_system::Render()
-{
-    particlesShader->Bind();
-
-    glm::mat4 view       = glm::mat4(1.0f);
-    glm::mat4 projection = glm::mat4(1.0f);
-
-    float wWidth  = window::s_Instance->windowProperties.width;
-    float wHeight = window::s_Instance->windowProperties.height;
-
-    view        = glm::translate(view, glm::vec3(0.0f, 0.0f, 0.0f));
-    projection  = glm::ortho(0.0f, wWidth, wHeight, 0.0f);
-
-    int viewLoc  = glGetUniformLocation(particlesShader->ID, "view");
-    int projLoc  = glGetUniformLocation(particlesShader->ID, "projection");
-
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    glBindVertexArray(VAO);
-    glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, totalParticles);
-    //glDrawArraysInstanced(GL_TRIANGLES, 0, 4, totalParticles);
-    glBindVertexArray(0);
-}
\ No newline at end of file
@@ -1,14 +1,26 @@
 #pragma once
 
+#include <climits>
 #include <iostream>
+#include <functional>
 #include <memory>
 #include <vector>
 #include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtc/type_ptr.hpp>
-#include <glad/glad.h>
 #include "timestep.h"
-#include "Shader.h"
+#include "particle_kernels.h"
+#include "particle_affectors.h"
+#include "particle_lut.h"
+#include "job_system.h"
+#include "particle_storage.h"
+#include "particle_random.h"
+#include "spatial_grid.h"
+#include "particle_sort.h"
+#include "particle_atlas.h"
+
+// Particles per job when the update is split across threads. Roughly 96
+// bytes of column data per particle keeps a chunk inside L2, and a multiple
+// of 16 keeps chunk edges on cache lines and full SIMD iterations.
+#define UPDATE_CHUNK_SIZE 2048
 
 struct particle_data
 {
@@ -22,6 +34,17 @@ struct particle_data
 	float emissionFrequency;
 	float totalLife;
 	float currentLife;
+	// Third axis, only read by 3D emitters
+	float positionZ;
+	float speedZ;
+};
+
+// 3D emitters add a z column to position and speed. Affectors, collisions
+// and the 2D draw order keys still work in the xy plane
+enum particle_space
+{
+	SPACE_2D,
+	SPACE_3D
 };
 
 enum particle_attribute
@@ -44,12 +67,115 @@ struct random_distributions
 	glm::vec2 speedXRange = glm::vec2(1, 5);
 	glm::vec2 speedYRange = glm::vec2(1, 5);
 	glm::vec2 lifeRange   = glm::vec2(0.1, 10);
+	glm::vec2 posZRange   = glm::vec2(-80, 80);
+	glm::vec2 speedZRange = glm::vec2(1, 5);
 	/*glm::vec2 scaleXRange = glm::vec2(0);
 	glm::vec2 scaleYRange = glm::vec2(4.5, 4.5);
 	glm::vec4 firstColor  = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
 	glm::vec4 lastColor   = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);*/
 };
 
+// Particle-particle collisions, run after integration when enabled
+struct collision_settings
+{
+	bool enabled = false;
+	float radius = 2.0f;      // Particles collide as discs of this radius
+	float restitution = 0.5f; // 0 cancels the approaching speed, 1 reflects it
+};
+
+// What the storage is kept sorted by when drawing needs an order. Particles
+// are drawn in storage order, lowest key first
+enum draw_sort_key
+{
+	SORT_NONE,
+	SORT_AGE,   // Oldest first, so newer particles blend over older ones
+	SORT_DEPTH, // Screen y in 2D, particles lower on the screen drawn in front.
+	            // Distance along viewForward in 3D, farthest first
+	SORT_KEY_COUNT
+};
+
+struct draw_sort_settings
+{
+	draw_sort_key key = SORT_NONE;
+	int layer = 0; // Emitters are drawn by ascending layer
+	// The insertion sort over last frame's order gives up, and the radix
+	// sort runs, after shifting elements this many times per particle. A
+	// shift costs a few percent of a particle's share of the radix sort
+	float coherentMoves = 8.0f;
+	// Camera of 3D emitters, set by the owner
+	glm::vec3 viewPosition = glm::vec3(0.0f);
+	glm::vec3 viewForward  = glm::vec3(0.0f, 0.0f, 1.0f);
+};
+
+// What the last SortForDrawing did
+struct draw_sort_stats
+{
+	bool radix = false;     // Fell back to sorting everything
+	bool reordered = false; // False when the storage was already in order
+	long long moves = 0;    // Elements shifted by the insertion sort
+	int merged = 0;         // New particles sorted apart and merged in
+};
+
+// Load shedding, set by a frame_governor or by hand. Emission runs at
+// emitScale of the configured rate and spawning stops at particleCap. With
+// decimate, live particles over the cap are removed too, evenly across the
+// storage, rather than left to die out
+struct emission_budget
+{
+	int priority = 0; // Lower priorities are throttled first
+	float emitScale = 1.0f;
+	int particleCap = INT_MAX;
+	bool decimate = false;
+	// Live particles the last time the emitter ran unthrottled, what the
+	// governor scales particleCap from
+	int unthrottledCount = 0;
+};
+
+// What the last Update spawned and what the budget and capacity cost
+struct emission_stats
+{
+	int owed = 0;      // Came due at the configured rate
+	int spawned = 0;
+	int shed = 0;      // Dropped by emitScale
+	int refused = 0;   // No room under particleCap or the capacity
+	int decimated = 0; // Live particles removed over particleCap
+};
+
+// Column tags for particle_storage
+struct position_column     { typedef glm::vec2 type; };
+struct prev_position_column { typedef glm::vec2 type; };
+struct speed_column        { typedef glm::vec2 type; };
+struct color_begin_column  { typedef glm::vec4 type; };
+struct color_end_column    { typedef glm::vec4 type; };
+struct color_column        { typedef glm::vec4 type; };
+struct scale_begin_column  { typedef glm::vec2 type; };
+struct scale_end_column    { typedef glm::vec2 type; };
+struct scale_column        { typedef glm::vec2 type; };
+struct current_life_column { typedef float type; };
+struct total_life_column   { typedef float type; };
+struct age_column          { typedef float type; };
+struct inverse_life_column { typedef float type; };
+struct position_z_column   { typedef float type; };
+struct prev_position_z_column { typedef float type; };
+struct speed_z_column      { typedef float type; };
+
+template <int BlockWidth>
+using particle_storage_layout = particle_storage<BlockWidth,
+	position_column, prev_position_column, speed_column,
+	color_begin_column, color_end_column, color_column,
+	scale_begin_column, scale_end_column, scale_column,
+	current_life_column, total_life_column,
+	age_column, inverse_life_column,
+	position_z_column, prev_position_z_column, speed_z_column>;
+
+typedef particle_storage_layout<0> particle_soa_storage;
+
+struct particle_system;
+
+// Draws the random spawn attributes for count particles, instantiated per
+// combination of the POSITION, SPEED and TOTAL_LIFE random options
+typedef void (*spawn_attribute_drawer)(particle_system& system, int count);
+
 struct particle_system
 {
 	particle_system(int maxParticles = 10000);
@@ -61,32 +187,151 @@ struct particle_system
     double msElapsed = 0;
     bool emitting = false;
     bool looping = true;
+	// Set before spawning, particles don't convert between spaces
+	particle_space space = SPACE_2D;
 	unsigned short int randomOptions = 0x00;
 
-	// PARTICLES
-	std::unique_ptr<std::vector<glm::vec2>> position;
-	std::unique_ptr<std::vector<glm::vec2>> speed;
-	std::unique_ptr<std::vector<glm::vec4>> colorBegin;
-	std::unique_ptr<std::vector<glm::vec4>> colorEnd;
-	std::unique_ptr<std::vector<glm::vec4>> color;
-	std::unique_ptr<std::vector<glm::vec3>> scaleBegin;
-	std::unique_ptr<std::vector<glm::vec3>> scaleEnd;
-	std::unique_ptr<std::vector<glm::vec3>> scale;
-	std::unique_ptr<std::vector<float>> currentLife;
-	std::unique_ptr<std::vector<float>> totalLife;
-	std::unique_ptr<std::vector<glm::mat4>> models;
+	// PARTICLES, every column lives in one aligned allocation
+	particle_soa_storage storage;
+
+	// Views into storage, refreshed by BindColumns
+	glm::vec2* position;
+	glm::vec2* prevPosition;
+	glm::vec2* speed;
+	glm::vec4* colorBegin;
+	glm::vec4* colorEnd;
+	glm::vec4* color;
+	glm::vec2* scaleBegin;
+	glm::vec2* scaleEnd;
+	glm::vec2* scale;
+	float* currentLife;
+	float* totalLife;
+	float* age;
+	float* inverseLife;
+	// Only kept up to date in SPACE_3D
+	float* positionZ;
+	float* prevPositionZ;
+	float* speedZ;
     
     particle_data particleData;
 	random_distributions rDistr;
 
-	void Init();
+	// Picked from the host CPU at construction, see SetSimdLevel
+	simd_level simdLevel;
+	particle_update_kernel updateKernel;
+
+	// update_feature mask the current particleData needs, see RefreshFeatures.
+	// Particles [0, staleCount) were spawned under older settings and run
+	// staleKernel, built for every feature they may still use
+	int updateFeatures = UPDATE_ALL;
+	int staleFeatures = 0;
+	int staleCount = 0;
+	particle_update_kernel staleKernel;
+	spawn_attribute_drawer spawnDrawer;
+
+	// Forces applied in order to the speeds before integration, one pass
+	// over each chunk per enabled affector
+	std::vector<particle_affector> affectors;
+	particle_affector_kernel affectorKernels[AFFECTOR_TYPE_COUNT];
+
+	// Color and scale curves over life, used instead of particleData's
+	// begin/end lerp while lifetime.enabled. lut is what the kernels read,
+	// see BakeLifetime
+	particle_lifetime lifetime;
+	particle_lut lut;
+
+	// Atlas cells the particles are drawn with, picked per instance from
+	// their normalized age. The atlas itself belongs to the renderer
+	particle_flipbook flipbook;
+
+	// Per-emitter generator. Particle n spawned since SetSeed draws value n
+	// of each random_stream
+	particle_random random;
+	uint64_t spawnSerial = 0;
+
+	// Per-spawn scratch for SpawnParticles
+	std::vector<glm::vec2> spawnOrigin;
+	std::vector<glm::vec2> spawnSpeed;
+	std::vector<float> spawnLife;
+	std::vector<float> spawnOriginZ;
+	std::vector<float> spawnSpeedZ;
+
+	// Scratch for CompactParticles, compactStorage is swapped with storage
+	std::vector<unsigned char> aliveMask;
+	std::vector<int> chunkOffsets;
+	particle_soa_storage compactStorage;
+
+	// Rebuilt over the positions every Update while collisions are enabled.
+	// Usable for neighbor queries until the next Update, also after the
+	// draw sort has reordered the particles
+	collision_settings collision;
+	spatial_grid grid;
+	std::vector<glm::vec2> sortedSpeed;
+
+	// Applied after each Update while drawSort.key is set. Compaction keeps
+	// survivors in order and spawns append, so the particles sorted last
+	// time stay close to sorted and only need the insertion sort. The
+	// unsortedCount particles appended since are sorted on their own and
+	// merged in. It only counts while a key is set
+	draw_sort_settings drawSort;
+	draw_sort_stats sortStats;
+	int unsortedCount = 0;
+	radix_sorter sorter;
+	std::vector<uint32_t> sortKeys;
+	std::vector<int> sortOrder;
+	// Inverse of sortOrder, where each particle went. Scratch for the grid
+	std::vector<int> sortDestination;
+
+	// Applied to timed emission every Update. emitCarry keeps the fraction
+	// of a particle emitScale left over between updates
+	emission_budget budget;
+	emission_stats emissionStats;
+	double emitCarry = 0.0;
+
+	// Optional, runs single threaded when null
+	job_system* jobSystem = nullptr;
+
 	void Emit();
 	void CreateParticle(const particle_data& data);
+	// Writes count particles in one pass. Particle j is aged by
+	// oldestAge - j * ageStep seconds, as if it had been emitted mid-frame
+	void SpawnParticles(int count, float oldestAge, float ageStep);
+	// Advances the emission clock and returns how many particles came due,
+	// with the ages SpawnParticles expects. Capacity is left to the caller
+	int AccrueEmission(timestep ts, float& oldestAge, float& ageStep);
+	// Fills spawnOrigin/spawnSpeed/spawnLife for the next count particles
+	void DrawSpawnAttributes(int count);
 	void Update(timestep ts);
 	void SwapData(const int a, const int b);
 	void Destroy(const int index);
+	// Drops every particle whose life ran out, keeping survivors in order
+	void CompactParticles();
+	// Ends the life of particles spread evenly over the storage until keep
+	// are left, the next compaction removes them
+	void DecimateParticles(int keep);
+	// Pushes overlapping particles apart and removes their approaching speed.
+	// Every particle reads the state at the grid build, so the result is the
+	// same for any thread count
+	void ResolveCollisions();
+	// Reorders the storage by drawSort.key, see draw_sort_settings
+	void SortForDrawing();
+	// Runs fn over UPDATE_CHUNK_SIZE chunks of [0, count), on jobSystem if set
+	void ForEachChunk(int count, const std::function<void(int, int)>& fn);
 	void Stop();
 
+	// Rebuilds lut from lifetime and particleData's begin/end scale. Call
+	// after editing either, live particles pick it up on their next update
+	void BakeLifetime();
+
+	void SetSimdLevel(simd_level level);
+	// Restarts the random sequence, a seed always gives the same particles
+	void SetSeed(uint64_t seed);
+	// Picks the kernel and spawn drawer instantiations matching particleData
+	// and randomOptions. Cheap when nothing changed
+	void RefreshFeatures();
+	particle_columns GetColumns();
+	void BindColumns();
+
 	inline int GetActiveParticles() { return(lastActiveParticle + 1); };
 	
 	void ParticleBurst(unsigned int nrParticles);
@@ -94,10 +339,4 @@ struct particle_system
 
 	void SetRandom(const particle_attribute attribute, bool value);
 	void RandomizeParticleAttributes();
-
-	void UploadToGPU();
-	void Render();
-
-	GLuint VAO, VBO, EBO, MODELS_VBO, COLORS_VBO;
-    std::unique_ptr<Shader> particlesShader;
 };
\ No newline at end of file
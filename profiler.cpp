@@ -0,0 +1,167 @@
+#include "profiler.h"
+
+#include <fstream>
+#include <iostream>
+
+static thread_local profile_ring* t_Ring = nullptr;
+
+profiler& profiler::Get()
+{
+    static profiler instance;
+    return instance;
+}
+
+std::atomic<bool> profiler::s_Enabled{ false };
+
+void profiler::Enable()
+{
+    if (IsEnabled()) {
+        return;
+    }
+    originTicks = Now();
+    originNs    = SteadyNanoseconds();
+
+#if PROFILER_USE_RDTSC
+    // Rough rate for the first frames, BeginFrame refines it
+    uint64_t ns;
+    do {
+        ns = SteadyNanoseconds();
+    } while (ns - originNs < 1000000);
+    ticksPerNs = (double)(Now() - originTicks) / (double)(ns - originNs);
+#endif
+
+    s_Enabled.store(true, std::memory_order_release);
+}
+
+uint64_t profiler::ToNanoseconds(uint64_t ticks)
+{
+    return originNs + (uint64_t)((double)(int64_t)(ticks - originTicks) / ticksPerNs);
+}
+
+profile_ring& profiler::GetThreadRing()
+{
+    if (!t_Ring) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        rings.push_back(std::make_unique<profile_ring>());
+        t_Ring = rings.back().get();
+        t_Ring->thread = (uint32_t)(rings.size() - 1);
+    }
+    return *t_Ring;
+}
+
+void profiler::BeginFrame()
+{
+    uint64_t now = Now();
+
+#if PROFILER_USE_RDTSC
+    // The longer the baseline the better the rate, so the origin stays put
+    uint64_t nowNs = SteadyNanoseconds();
+    if (nowNs > originNs) {
+        ticksPerNs = (double)(now - originTicks) / (double)(nowNs - originNs);
+    }
+#endif
+
+    if (history.empty()) {
+        history.resize(PROFILER_HISTORY_FRAMES);
+    }
+
+    profile_frame* frame = nullptr;
+    if (!paused && frameStart != 0) {
+        frame = &history[historyHead];
+        frame->start = ToNanoseconds(frameStart);
+        frame->end   = ToNanoseconds(now);
+        frame->events.clear();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (std::unique_ptr<profile_ring>& ring : rings) {
+            uint64_t r = ring->read.load(std::memory_order_relaxed);
+            uint64_t w = ring->written.load(std::memory_order_acquire);
+            if (frame) {
+                for (; r < w; r++) {
+                    profile_event e = ring->events[r % PROFILER_RING_EVENTS];
+                    e.start = ToNanoseconds(e.start);
+                    e.end   = ToNanoseconds(e.end);
+                    frame->events.push_back(e);
+                }
+            }
+            ring->read.store(w, std::memory_order_release);
+        }
+    }
+
+    if (frame) {
+        historyHead  = (historyHead + 1) % PROFILER_HISTORY_FRAMES;
+        historyCount = historyCount < PROFILER_HISTORY_FRAMES ? historyCount + 1 : PROFILER_HISTORY_FRAMES;
+    }
+    frameStart = now;
+}
+
+const profile_frame* profiler::GetLastFrame()
+{
+    if (historyCount == 0) {
+        return nullptr;
+    }
+    return &history[(historyHead + PROFILER_HISTORY_FRAMES - 1) % PROFILER_HISTORY_FRAMES];
+}
+
+int profiler::GetThreadCount()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    return (int)rings.size();
+}
+
+static void WriteJsonString(std::ofstream& out, const char* s)
+{
+    out << '"';
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            out << '\\';
+        }
+        out << *s;
+    }
+    out << '"';
+}
+
+bool profiler::ExportChromeTrace(const char* path)
+{
+    std::ofstream out(path);
+    if (!out) {
+        std::cout << "Profiler: could not write " << path << std::endl;
+        return false;
+    }
+
+    int oldest = (historyHead + PROFILER_HISTORY_FRAMES - historyCount) % PROFILER_HISTORY_FRAMES;
+    uint64_t origin = historyCount > 0 ? history[oldest].start : 0;
+
+    // Complete ("X") events, microseconds from the oldest kept frame
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (int f = 0; f < historyCount; f++) {
+        const profile_frame& frame = history[(oldest + f) % PROFILER_HISTORY_FRAMES];
+
+        out << (first ? "" : ",\n") << "{\"name\":\"Frame\",\"ph\":\"X\",\"pid\":1,\"tid\":-1"
+            << ",\"ts\":" << (frame.start - origin) / 1000.0
+            << ",\"dur\":" << (frame.end - frame.start) / 1000.0 << "}";
+        first = false;
+
+        for (const profile_event& e : frame.events) {
+            out << ",\n{\"name\":";
+            WriteJsonString(out, e.name);
+            out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.thread
+                << ",\"ts\":" << (int64_t)(e.start - origin) / 1000.0
+                << ",\"dur\":" << (e.end - e.start) / 1000.0 << "}";
+        }
+    }
+
+    int threads = GetThreadCount();
+    for (int t = -1; t < threads; t++) {
+        out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t
+            << ",\"args\":{\"name\":\"" << (t < 0 ? "Frames" : "Thread ") << (t < 0 ? "" : std::to_string(t)) << "\"}}";
+        first = false;
+    }
+    out << "\n]}\n";
+
+    std::cout << "Profiler: wrote " << historyCount << " frames to " << path << std::endl;
+    return true;
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+	#define PROFILER_USE_RDTSC 1
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#else
+		#include <x86intrin.h>
+	#endif
+#else
+	#define PROFILER_USE_RDTSC 0
+#endif
+
+// Build with PARTICLES_PROFILER=0 to compile every PROFILE_SCOPE out
+#ifndef PARTICLES_PROFILER
+	#define PARTICLES_PROFILER 1
+#endif
+
+// Per thread, a frame's worth of zones must fit or the rest are dropped
+#define PROFILER_RING_EVENTS 16384
+// Frames kept for the timeline and the trace export
+#define PROFILER_HISTORY_FRAMES 120
+
+struct profile_event
+{
+	const char* name; // Must outlive the profiler, in practice a literal
+	uint64_t start;   // Ticks while in a ring, ns once drained into a frame
+	uint64_t end;
+	uint32_t depth;   // Nesting level within its thread
+	uint32_t thread;
+};
+
+// Written only by its thread and drained only by profiler::BeginFrame, so
+// the two sides just publish their indices
+struct profile_ring
+{
+	profile_event events[PROFILER_RING_EVENTS];
+	std::atomic<uint64_t> written{ 0 };
+	std::atomic<uint64_t> read{ 0 };
+	uint32_t depth  = 0;
+	uint32_t thread = 0;
+	uint64_t dropped = 0;
+
+	inline void Push(const profile_event& e)
+	{
+		uint64_t w = written.load(std::memory_order_relaxed);
+		if (w - read.load(std::memory_order_acquire) >= PROFILER_RING_EVENTS) {
+			dropped++;
+			return;
+		}
+		events[w % PROFILER_RING_EVENTS] = e;
+		written.store(w + 1, std::memory_order_release);
+	};
+};
+
+struct profile_frame
+{
+	uint64_t start = 0;
+	uint64_t end   = 0;
+	std::vector<profile_event> events;
+};
+
+struct profiler
+{
+	static profiler& Get();
+
+	// Raw timestamp for the hot path. The TSC is constant rate and synced
+	// across cores on anything recent, and reads in a fraction of the time
+	// of steady_clock; ticks are converted when a frame is drained
+	static inline uint64_t Now()
+	{
+#if PROFILER_USE_RDTSC
+		return __rdtsc();
+#else
+		return SteadyNanoseconds();
+#endif
+	};
+	static inline uint64_t SteadyNanoseconds()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	};
+
+	// Zones only record once Enable has been called. Headless runs and the
+	// benchmark never drain the rings, so there a zone costs one branch
+	// instead of two timestamps and a dropped event
+	void Enable();
+	static inline bool IsEnabled()
+	{
+		return s_Enabled.load(std::memory_order_relaxed);
+	};
+
+	// The calling thread's ring, registered on first use
+	profile_ring& GetThreadRing();
+
+	// Closes the previous frame with every zone recorded since, on any
+	// thread, and starts the next one. Call once per frame from one thread
+	void BeginFrame();
+	// Last closed frame, or nullptr before the first one
+	const profile_frame* GetLastFrame();
+	int GetThreadCount();
+
+	// Chrome trace event JSON of the kept frames, for chrome://tracing or
+	// ui.perfetto.dev
+	bool ExportChromeTrace(const char* path);
+
+	// Zones keep being drained while paused, but the history stays frozen
+	bool paused = false;
+
+	std::mutex registryMutex;
+	std::vector<std::unique_ptr<profile_ring>> rings;
+
+	std::vector<profile_frame> history;
+	int historyHead  = 0;
+	int historyCount = 0;
+	uint64_t frameStart = 0;
+
+	// Ticks to ns, refined against steady_clock every frame
+	uint64_t originTicks = 0;
+	uint64_t originNs    = 0;
+	double ticksPerNs    = 1.0;
+
+private:
+	profiler() = default;
+	uint64_t ToNanoseconds(uint64_t ticks);
+
+	static std::atomic<bool> s_Enabled;
+};
+
+struct profile_scope
+{
+	inline profile_scope(const char* name)
+		: ring(profiler::IsEnabled() ? &profiler::Get().GetThreadRing() : nullptr), name(name)
+	{
+		if (ring) {
+			depth = ring->depth++;
+			start = profiler::Now();
+		}
+	};
+
+	inline ~profile_scope()
+	{
+		if (ring) {
+			ring->depth--;
+			ring->Push({ name, start, profiler::Now(), depth, ring->thread });
+		}
+	};
+
+	profile_ring* ring;
+	const char* name;
+	uint32_t depth = 0;
+	uint64_t start = 0;
+};
+
+#if PARTICLES_PROFILER
+	#define PROFILE_CONCAT_INNER(a, b) a##b
+	#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+	#define PROFILE_SCOPE(name) profile_scope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#else
+	#define PROFILE_SCOPE(name)
+#endif
@@ -0,0 +1,175 @@
+#include "spatial_grid.h"
+
+#include "profiler.h"
+
+static void ForEachRange(job_system* jobSystem, int count, const std::function<void(int, int)>& fn)
+{
+    if (jobSystem) {
+        jobSystem->ParallelFor(count, SPATIAL_GRID_CHUNK_SIZE, fn);
+    }
+    else if (count > 0) {
+        fn(0, count);
+    }
+}
+
+void spatial_grid::Build(const glm::vec2* positions, int count, float size, job_system* jobSystem)
+{
+    PROFILE_SCOPE("Grid build");
+
+    particleCount = count;
+    if (count == 0) {
+        width = height = cellCount = 0;
+        return;
+    }
+
+    // 1. Bounds, per block and then across blocks
+    int blocks = (count + SPATIAL_GRID_CHUNK_SIZE - 1) / SPATIAL_GRID_CHUNK_SIZE;
+    blockMin.resize(blocks);
+    blockMax.resize(blocks);
+    ForEachRange(jobSystem, count, [&](int begin, int end) {
+        glm::vec2 lo = positions[begin];
+        glm::vec2 hi = positions[begin];
+        for (int i = begin + 1; i < end; i++) {
+            lo = glm::min(lo, positions[i]);
+            hi = glm::max(hi, positions[i]);
+        }
+        blockMin[begin / SPATIAL_GRID_CHUNK_SIZE] = lo;
+        blockMax[begin / SPATIAL_GRID_CHUNK_SIZE] = hi;
+    });
+
+    glm::vec2 lo = blockMin[0];
+    glm::vec2 hi = blockMax[0];
+    for (int b = 1; b < blocks; b++) {
+        lo = glm::min(lo, blockMin[b]);
+        hi = glm::max(hi, blockMax[b]);
+    }
+
+    // A few stray particles far away would otherwise ask for a huge grid.
+    // Larger cells only mean more candidates per query
+    int maxCells = count * SPATIAL_GRID_CELLS_PER_PARTICLE;
+    maxCells = maxCells > SPATIAL_GRID_MIN_CELLS ? maxCells : SPATIAL_GRID_MIN_CELLS;
+    glm::vec2 extent = hi - lo;
+    cellSize = size > SPATIAL_GRID_MIN_CELL_SIZE ? size : SPATIAL_GRID_MIN_CELL_SIZE;
+
+    // A NaN or infinite position leaves no bounds to divide, so every
+    // particle shares one cell
+    if (!std::isfinite(extent.x) || !std::isfinite(extent.y)) {
+        extent = glm::vec2(0.0f);
+    }
+    for (int growth = 0; growth < SPATIAL_GRID_MAX_GROWTH; growth++) {
+        if ((extent.x / cellSize + 1.0f) * (extent.y / cellSize + 1.0f) <= (float)maxCells) {
+            break;
+        }
+        cellSize *= 1.5f;
+    }
+    inverseCellSize = 1.0f / cellSize;
+    origin    = lo;
+    width     = (int)(extent.x * inverseCellSize) + 1;
+    height    = (int)(extent.y * inverseCellSize) + 1;
+    cellCount = width * height;
+
+    if (cursorCapacity < cellCount) {
+        cellCursor     = std::unique_ptr<std::atomic<int>[]>(new std::atomic<int>[cellCount]);
+        cursorCapacity = cellCount;
+    }
+    cellStart.resize(cellCount + 1);
+    particleCell.resize(count);
+    sortedIndex.resize(count);
+    sortedPosition.resize(count);
+
+    // Locked increments cost several times a plain one, so they are only
+    // used when other threads can touch the same cell
+    std::atomic<int>* cursor = cellCursor.get();
+    bool shared = jobSystem && jobSystem->GetThreadCount() > 1;
+    auto claim = [&](int cell) {
+        if (shared) {
+            return cursor[cell].fetch_add(1, std::memory_order_relaxed);
+        }
+        int value = cursor[cell].load(std::memory_order_relaxed);
+        cursor[cell].store(value + 1, std::memory_order_relaxed);
+        return value;
+    };
+
+    ForEachRange(jobSystem, cellCount, [&](int begin, int end) {
+        for (int c = begin; c < end; c++) {
+            cursor[c].store(0, std::memory_order_relaxed);
+        }
+    });
+
+    ForEachRange(jobSystem, count, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            int cell = CellOf(positions[i]);
+            particleCell[i] = cell;
+            claim(cell);
+        }
+    });
+
+    // 2. Exclusive prefix sum, per block and then across blocks
+    blocks = (cellCount + SPATIAL_GRID_CHUNK_SIZE - 1) / SPATIAL_GRID_CHUNK_SIZE;
+    blockSums.resize(blocks + 1);
+    ForEachRange(jobSystem, cellCount, [&](int begin, int end) {
+        int sum = 0;
+        for (int c = begin; c < end; c++) {
+            cellStart[c] = sum;
+            sum += cursor[c].load(std::memory_order_relaxed);
+        }
+        blockSums[begin / SPATIAL_GRID_CHUNK_SIZE + 1] = sum;
+    });
+
+    blockSums[0] = 0;
+    for (int b = 0; b < blocks; b++) {
+        blockSums[b + 1] += blockSums[b];
+    }
+    cellStart[cellCount] = count;
+
+    ForEachRange(jobSystem, cellCount, [&](int begin, int end) {
+        int offset = blockSums[begin / SPATIAL_GRID_CHUNK_SIZE];
+        for (int c = begin; c < end; c++) {
+            cellStart[c] += offset;
+            cursor[c].store(cellStart[c], std::memory_order_relaxed);
+        }
+    });
+
+    // 3. Scatter
+    ForEachRange(jobSystem, count, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            sortedIndex[claim(particleCell[i])] = i;
+        }
+    });
+
+    // 4. Cells hold a handful of particles, insertion sort is enough
+    ForEachRange(jobSystem, cellCount, [&](int begin, int end) {
+        for (int c = begin; c < end; c++) {
+            int first = cellStart[c];
+            int last  = cellStart[c + 1];
+            for (int s = first + 1; s < last; s++) {
+                int index = sortedIndex[s];
+                int t = s;
+                while (t > first && sortedIndex[t - 1] > index) {
+                    sortedIndex[t] = sortedIndex[t - 1];
+                    t--;
+                }
+                sortedIndex[t] = index;
+            }
+            for (int s = first; s < last; s++) {
+                sortedPosition[s] = positions[sortedIndex[s]];
+            }
+        }
+    });
+}
+
+void spatial_grid::QueryRadius(glm::vec2 point, float radius, std::vector<int>& out) const
+{
+    ForEachNeighbor(point, radius, [&](int slot) {
+        out.push_back(sortedIndex[slot]);
+    });
+}
+
+void spatial_grid::Remap(const int* newIndex, job_system* jobSystem)
+{
+    ForEachRange(jobSystem, particleCount, [&](int begin, int end) {
+        for (int s = begin; s < end; s++) {
+            sortedIndex[s] = newIndex[sortedIndex[s]];
+        }
+    });
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include "job_system.h"
+
+// Upper bound on cells per particle. When the particles' bounds would need
+// more cells than that, cells grow past the requested size instead
+#define SPATIAL_GRID_CELLS_PER_PARTICLE 2
+#define SPATIAL_GRID_MIN_CELLS 1024
+// Smallest cell Build accepts, and how many times it grows the cells before
+// giving up on the bounds
+#define SPATIAL_GRID_MIN_CELL_SIZE 1e-3f
+#define SPATIAL_GRID_MAX_GROWTH 256
+// Elements per job in the build passes
+#define SPATIAL_GRID_CHUNK_SIZE 8192
+
+// Uniform grid over the particles' bounding box, rebuilt from scratch every
+// frame by a counting sort:
+//
+//   1. bounds, then the cell of every particle, counted with atomics
+//   2. exclusive prefix sum of the counts into cellStart
+//   3. scatter of the particle indices to their cell's range
+//   4. every cell's indices sorted, so the order doesn't depend on thread
+//      timing, and positions gathered into the same order
+//
+// Every pass is a linear, parallel sweep. Cells are numbered row by row, so
+// a query reads three short runs of memory and consecutive slots are
+// spatial neighbors.
+struct spatial_grid
+{
+	// Indexes positions[0, count) into cells of at least cellSize, which is
+	// raised to SPATIAL_GRID_MIN_CELL_SIZE. Runs on jobSystem when not null
+	void Build(const glm::vec2* positions, int count, float cellSize, job_system* jobSystem = nullptr);
+
+	// Calls fn(slot) for every particle closer than radius to point, where
+	// sortedIndex[slot] is the particle and sortedPosition[slot] its position
+	// at Build
+	template <typename Fn>
+	void ForEachNeighbor(glm::vec2 point, float radius, Fn&& fn) const;
+
+	// Appends the indices of the particles closer than radius to point
+	void QueryRadius(glm::vec2 point, float radius, std::vector<int>& out) const;
+
+	// Follows a reordering of the particles that moved particle i to
+	// newIndex[i]. The slots keep their order, so queries give the same
+	// particles as before under their new indices
+	void Remap(const int* newIndex, job_system* jobSystem = nullptr);
+
+	// Clamped to the grid, points outside it belong to the border cells
+	inline int CellCoordinate(float x, float origin, int cells) const
+	{
+		float c = (x - origin) * inverseCellSize;
+		c = c < 0.0f ? 0.0f : c;
+		int cell = c < (float)cells ? (int)c : cells - 1;
+		return cell;
+	};
+	inline int CellOf(glm::vec2 p) const
+	{
+		return CellCoordinate(p.y, origin.y, height) * width + CellCoordinate(p.x, origin.x, width);
+	};
+
+	float cellSize        = 1.0f;
+	float inverseCellSize = 1.0f;
+	glm::vec2 origin      = glm::vec2(0.0f);
+	int width             = 0;
+	int height            = 0;
+	int cellCount         = 0;
+	int particleCount     = 0;
+
+	// cellCount + 1 offsets into sortedIndex/sortedPosition
+	std::vector<int> cellStart;
+	std::vector<int> sortedIndex;
+	std::vector<glm::vec2> sortedPosition;
+
+	// Build scratch
+	std::vector<int> particleCell;
+	std::unique_ptr<std::atomic<int>[]> cellCursor;
+	int cursorCapacity = 0;
+	std::vector<int> blockSums;
+	std::vector<glm::vec2> blockMin;
+	std::vector<glm::vec2> blockMax;
+};
+
+template <typename Fn>
+void spatial_grid::ForEachNeighbor(glm::vec2 point, float radius, Fn&& fn) const
+{
+	if (particleCount == 0) {
+		return;
+	}
+	float radius2 = radius * radius;
+
+	int x0 = CellCoordinate(point.x - radius, origin.x, width);
+	int x1 = CellCoordinate(point.x + radius, origin.x, width);
+	int y0 = CellCoordinate(point.y - radius, origin.y, height);
+	int y1 = CellCoordinate(point.y + radius, origin.y, height);
+
+	// A row's cells are adjacent, so each row is one run of slots
+	for (int y = y0; y <= y1; y++) {
+		int end = cellStart[y * width + x1 + 1];
+		for (int slot = cellStart[y * width + x0]; slot < end; slot++) {
+			glm::vec2 d = sortedPosition[slot] - point;
+			if (d.x * d.x + d.y * d.y < radius2) {
+				fn(slot);
+			}
+		}
+	}
+}
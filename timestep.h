@@ -11,3 +11,45 @@ struct timestep
 
 	float time;
 };
+
+// Turns variable frame times into a whole number of fixed simulation ticks.
+// The remainder carries over, and GetAlpha tells the renderer how far the
+// frame is between the last two ticks.
+struct fixed_timestep
+{
+	fixed_timestep(float tickRate = 60.0f) : tickSeconds(1.0f / tickRate) {};
+
+	// Adds a frame's time and returns how many ticks to run for it
+	inline int Advance(timestep frame)
+	{
+		// A breakpoint or window drag shouldn't turn into seconds of catch-up
+		float seconds = frame.GetSeconds();
+		accumulator += seconds < maxFrameSeconds ? seconds : maxFrameSeconds;
+
+		int ticks = (int)(accumulator / tickSeconds);
+		accumulator -= ticks * (double)tickSeconds;
+
+		// Spiral of death guard: when ticks cost more than they cover, drop
+		// the backlog instead of falling further behind every frame
+		if (ticks > maxSubsteps) {
+			droppedTicks += ticks - maxSubsteps;
+			ticks = maxSubsteps;
+		}
+
+		lastSubsteps = ticks;
+		return ticks;
+	};
+
+	inline float GetAlpha() { return (float)(accumulator / tickSeconds); };
+	inline timestep GetTick() { return timestep(tickSeconds); };
+	inline void SetTickRate(float rate) { tickSeconds = 1.0f / rate; };
+
+	float tickSeconds;
+	int maxSubsteps = 8;
+	float maxFrameSeconds = 0.25f;
+	double accumulator = 0.0;
+
+	// Stats
+	int lastSubsteps = 0;
+	long long droppedTicks = 0;
+};